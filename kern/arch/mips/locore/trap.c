@@ -29,6 +29,7 @@
 
 #include <types.h>
 #include <signal.h>
+#include <kern/wait.h>
 #include <lib.h>
 #include <mips/specialreg.h>
 #include <mips/trapframe.h>
@@ -40,6 +41,7 @@
 #include <mainbus.h>
 #include <syscall.h>
 #include <opt-A3.h>
+#include "opt-A2.h"
 #include <addrspace.h>
 #include <proc.h>
 
@@ -115,32 +117,10 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 	(void)epc;
 	(void)vaddr;
 
-	struct addrspace *as;
-  	struct proc *p = curproc;
-
-  	KASSERT(curproc->p_addrspace != NULL);
-  	as_deactivate();
-	/*
-	* clear p_addrspace before calling as_destroy. Otherwise if
-	* as_destroy sleeps (which is quite possible) when we
-	* come back we'll be calling as_activate on a
-	* half-destroyed address space. This tends to be
-	* messily fatal.
-	*/
-	as = curproc_setas(NULL);
-	as_destroy(as);
-
-	/* detach this thread from its process */
-	/* note: curproc cannot be used after this call  */
-	proc_remthread(curthread);
-
-	/* if this is the last user process in the system, proc_destroy()
-	 will wake up the kernel menu thread */
-	proc_destroy(p);
-
-	thread_exit();
-	/* thread_exit() does not return, so we should never get here */
-	panic("return from thread_exit in kill_curthread\n");
+	/* The whole process dies, not just this thread. */
+	proc_exit(_MKWAIT_SIG(sig));
+	/* proc_exit() does not return, so we should never get here */
+	panic("return from proc_exit in kill_curthread\n");
 // #else
 // 	kprintf("Fatal user mode trap %u sig %d (%s, epc 0x%x, vaddr 0x%x)\n",
 // 		code, sig, trapcodenames[code], epc, vaddr);
@@ -215,6 +195,9 @@ mips_trap(struct trapframe *tf)
 			doadjust = false;
 		}
 
+		/* For hardclock(), to charge the tick to user or system time. */
+		curcpu->c_intruser = !iskern;
+
 		mainbus_interrupt(tf);
 
 		if (doadjust) {
@@ -225,6 +208,19 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+#if OPT_A2
+		/*
+		 * Another thread of this process called _exit or died;
+		 * leave instead of going back to user mode. (Turn
+		 * interrupts back on first, as for other traps below.)
+		 */
+		if (!iskern && curproc->p_exiting) {
+			spl = splhigh();
+			splx(spl);
+			proc_exit(0);
+		}
+#endif
 		goto done2;
 	}
 
@@ -345,6 +341,13 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+#if OPT_A2
+	/* As above: don't go back to user mode in an exiting process. */
+	if (!iskern && curproc->p_exiting) {
+		proc_exit(0);
+	}
+#endif
+
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
@@ -109,6 +109,24 @@ syscall(struct trapframe *tf)
 		err = sys___time((userptr_t)tf->tf_a0,
 				 (userptr_t)tf->tf_a1);
 		break;
+
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_sched_edf:
+		err = sys_sched_edf(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_sched_setshare:
+		err = sys_sched_setshare(tf->tf_a0, &retval);
+		break;
+
+	    case SYS_schedtrace:
+		err = sys_schedtrace(tf->tf_a0, (userptr_t)tf->tf_a1,
+				     tf->tf_a2, &retval);
+		break;
 #ifdef UW
 	case SYS_write:
 	  err = sys_write((int)tf->tf_a0,
@@ -122,6 +140,9 @@ syscall(struct trapframe *tf)
 	  panic("unexpected return from sys__exit");
 	  break;
 
+	case SYS_getrusage:
+	  err = sys_getrusage((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+	  break;
 	case SYS_getpid:
 	  err = sys_getpid((pid_t *)&retval);
 	  break;
@@ -140,6 +161,26 @@ syscall(struct trapframe *tf)
 	case SYS_execv:
 	  err = sys_execv((char*)tf->tf_a0, (char**)tf->tf_a1);
 	  break;
+	case SYS_spawn:
+	  err = sys_spawn((char*)tf->tf_a0, (char**)tf->tf_a1,
+			  (pid_t *)&retval);
+	  break;
+	case SYS___threadfork:
+	  err = sys___threadfork((userptr_t)tf->tf_a0,
+				 (userptr_t)tf->tf_a1, &retval);
+	  break;
+	case SYS_threadexit:
+	  sys_threadexit((int)tf->tf_a0);
+	  /* sys_threadexit does not return */
+	  panic("unexpected return from sys_threadexit");
+	  break;
+	case SYS_threadjoin:
+	  err = sys_threadjoin((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+	  break;
+	case SYS_futex:
+	  err = sys_futex((userptr_t)tf->tf_a0, (int)tf->tf_a1,
+			  (int)tf->tf_a2, &retval);
+	  break;
 
  
 	default:
@@ -47,6 +47,15 @@
 /* under dumbvm, always have 48k of user stack */
 #define DUMBVM_STACKPAGES    12
 
+/*
+ * Extra threads get 16k stacks, stacked downwards below the main
+ * stack with an unmapped page under each one to catch overflows.
+ */
+#define DUMBVM_TSTACKPAGES   4
+#define DUMBVM_TSTACKTOP(slot) \
+	(USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE - PAGE_SIZE - \
+	 (slot) * (DUMBVM_TSTACKPAGES + 1) * PAGE_SIZE)
+
 /*
  * Wrap rma_stealmem in a spinlock.
  */
@@ -162,6 +171,35 @@ vm_tlbshootdown(const struct tlbshootdown *ts)
 	panic("dumbvm tried to do tlb shootdown?!\n");
 }
 
+/*
+ * If VADDR is in one of AS's thread stacks, put the matching physical
+ * address in *PADDR and return true.
+ */
+static
+bool
+as_find_threadstack(struct addrspace *as, vaddr_t vaddr, paddr_t *paddr)
+{
+	vaddr_t top, base;
+	int slot;
+
+	for (slot = 0; slot < AS_MAXTHREADSTACKS; slot++) {
+		top = DUMBVM_TSTACKTOP(slot);
+		base = top - DUMBVM_TSTACKPAGES * PAGE_SIZE;
+		if (vaddr >= top) {
+			/* in the guard page above this slot */
+			return false;
+		}
+		if (vaddr >= base) {
+			if (as->as_tstackpbase[slot] == 0) {
+				return false;
+			}
+			*paddr = (vaddr - base) + as->as_tstackpbase[slot];
+			return true;
+		}
+	}
+	return false;
+}
+
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
@@ -239,6 +277,10 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	else if (faultaddress >= stackbase && faultaddress < stacktop) {
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 	}
+	else if (faultaddress < stackbase &&
+		 as_find_threadstack(as, faultaddress, &paddr)) {
+		/* paddr set */
+	}
 	else {
 		return EFAULT;
 	}
@@ -294,6 +336,10 @@ as_create(void)
 	as->as_pbase2 = 0;
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;
+	for (int i = 0; i < AS_MAXTHREADSTACKS; i++) {
+		as->as_tstackpbase[i] = 0;
+	}
+	as->as_tstackinuse = 0;
 	as->as_loaded = false;
 
 	return as;
@@ -305,6 +351,11 @@ as_destroy(struct addrspace *as)
 	free_kpages(as->as_pbase1);
 	free_kpages(as->as_pbase2);
 	free_kpages(as->as_stackpbase);
+	for (int i = 0; i < AS_MAXTHREADSTACKS; i++) {
+		if (as->as_tstackpbase[i] != 0) {
+			free_kpages(as->as_tstackpbase[i]);
+		}
+	}
 	kfree(as);
 }
 
@@ -437,7 +488,45 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 }
 
 int
-as_copy(struct addrspace *old, struct addrspace **ret)
+as_define_threadstack(struct addrspace *as, int *slot, vaddr_t *stackptr)
+{
+	int i;
+
+	for (i = 0; i < AS_MAXTHREADSTACKS; i++) {
+		if ((as->as_tstackinuse & (1U << i)) == 0) {
+			break;
+		}
+	}
+	if (i == AS_MAXTHREADSTACKS) {
+		return ENOMEM;
+	}
+
+	/* Keep the pages of a released slot around for the next thread. */
+	if (as->as_tstackpbase[i] == 0) {
+		as->as_tstackpbase[i] = getppages(DUMBVM_TSTACKPAGES);
+		if (as->as_tstackpbase[i] == 0) {
+			return ENOMEM;
+		}
+	}
+	as_zero_region(as->as_tstackpbase[i], DUMBVM_TSTACKPAGES);
+
+	as->as_tstackinuse |= 1U << i;
+	*slot = i;
+	*stackptr = DUMBVM_TSTACKTOP(i);
+	return 0;
+}
+
+void
+as_release_threadstack(struct addrspace *as, int slot)
+{
+	KASSERT(slot >= 0 && slot < AS_MAXTHREADSTACKS);
+	KASSERT(as->as_tstackinuse & (1U << slot));
+
+	as->as_tstackinuse &= ~(1U << slot);
+}
+
+int
+as_copy(struct addrspace *old, int keepslot, struct addrspace **ret)
 {
 	struct addrspace *new;
 
@@ -472,6 +561,28 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	memmove((void *)PADDR_TO_KVADDR(new->as_stackpbase),
 		(const void *)PADDR_TO_KVADDR(old->as_stackpbase),
 		DUMBVM_STACKPAGES*PAGE_SIZE);
+
+	/*
+	 * Copy the stack of the thread calling fork, if it's running
+	 * on one of the thread stacks. It stays in use for as long as
+	 * the copy lasts: in the child that thread is the main thread,
+	 * which has no slot to give back.
+	 */
+	if (keepslot >= 0) {
+		int i = keepslot;
+
+		KASSERT(i < AS_MAXTHREADSTACKS);
+		KASSERT(old->as_tstackinuse & (1U << i));
+		new->as_tstackpbase[i] = getppages(DUMBVM_TSTACKPAGES);
+		if (new->as_tstackpbase[i] == 0) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+		memmove((void *)PADDR_TO_KVADDR(new->as_tstackpbase[i]),
+			(const void *)PADDR_TO_KVADDR(old->as_tstackpbase[i]),
+			DUMBVM_TSTACKPAGES*PAGE_SIZE);
+		new->as_tstackinuse = 1U << i;
+	}
 	
 	*ret = new;
 	return 0;
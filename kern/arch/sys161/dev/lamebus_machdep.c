@@ -73,6 +73,59 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Read the on-chip cycle counter; it restarts from zero at each timer
+ * interrupt.
+ */
+static
+uint32_t
+mips_timer_get(void)
+{
+	uint32_t count;
+
+	/* $9 == c0_count */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
+/*
+ * Hooks for tickless idle; see hardclock_idle().
+ */
+void
+mainbus_settimer(unsigned hardclocks)
+{
+	KASSERT(hardclocks > 0);
+	KASSERT(hardclocks <= 0xffffffff / (CPU_FREQUENCY / HZ));
+	mips_timer_set(CPU_FREQUENCY / HZ * hardclocks);
+}
+
+unsigned
+mainbus_timer_elapsed(void)
+{
+	return mips_timer_get() / (CPU_FREQUENCY / HZ);
+}
+
+/*
+ * The cycle counter restarts at every hardclock, so add in the
+ * hardclocks gone by.
+ */
+uint64_t
+mainbus_cycles(void)
+{
+	uint64_t cycles;
+
+	cycles = mips_timer_get();
+	if (CURCPU_EXISTS()) {
+		cycles += (uint64_t)curcpu->c_hardclocks * (CPU_FREQUENCY / HZ);
+	}
+	return cycles;
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -39,6 +39,16 @@
 
 struct vnode;
 
+/* Most stacks for extra user threads an address space can have. */
+#define AS_MAXTHREADSTACKS 16
+
+/*
+ * Most of the stack from as_define_stack that exec may fill with the
+ * argument block; the rest is left for the program. (dumbvm's stack
+ * is 48k.)
+ */
+#define AS_STACKARGMAX (32 * 1024)
+
 
 /* 
  * Address space - data structure associated with the virtual memory
@@ -56,6 +66,10 @@ struct addrspace {
   size_t as_npages2;
   paddr_t as_stackpbase;
 
+  /* stacks for extra user threads; pbase is 0 until first used */
+  paddr_t as_tstackpbase[AS_MAXTHREADSTACKS];
+  uint32_t as_tstackinuse;              /* one bit per slot */
+
   //added
   bool as_loaded;
   bool as_read;
@@ -75,7 +89,10 @@ struct addrspace {
  *    as_copy   - create a new address space that is an exact copy of
  *                an old one. Probably calls as_create to get a new
  *                empty address space and fill it in, but that's up to
- *                you.
+ *                you. Of the extra thread stacks, only slot KEEPSLOT
+ *                (-1 for none) is copied: it's for fork, and the other
+ *                threads don't exist in the child, so nothing would
+ *                ever release their slots.
  *
  *    as_activate - make curproc's address space the one currently
  *                "seen" by the processor.
@@ -98,10 +115,19 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *
+ *    as_define_threadstack - set up a stack for another thread in the
+ *                address space. Hands back the slot it occupies and
+ *                its initial stack pointer. Callers must not run this
+ *                concurrently on the same address space.
+ *
+ *    as_release_threadstack - free up a slot from as_define_threadstack
+ *                once its thread is done with it.
  */
 
 struct addrspace *as_create(void);
-int               as_copy(struct addrspace *src, struct addrspace **ret);
+int               as_copy(struct addrspace *src, int keepslot,
+                          struct addrspace **ret);
 void              as_activate(void);
 void              as_deactivate(void);
 void              as_destroy(struct addrspace *);
@@ -114,6 +140,9 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_define_threadstack(struct addrspace *as, int *slot,
+                                        vaddr_t *initstackptr);
+void              as_release_threadstack(struct addrspace *as, int slot);
 
 
 /*
@@ -36,10 +36,13 @@
  * Time-related definitions.
  *
  * hardclock() is called on every CPU HZ times a second, possibly only
- * when the CPU is not idle, for scheduling.
+ * when the CPU is not idle, for scheduling. An idling CPU calls
+ * hardclock_idle() to stop its periodic tick, and hardclock_unidle()
+ * to restart it when it has work again; the ticks skipped in between
+ * are caught up on in one call to hardclock().
  *
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU every LT_GRANULARITY usec to run
+ * timeouts (see <timeout.h>).
  *
  * gettime() may be used to fetch the current time of day.
  * getinterval() computes the time from time1 to time2.
@@ -59,6 +62,8 @@
 void hardclock_bootstrap(void);
 
 void hardclock(void);
+void hardclock_idle(void);
+void hardclock_unidle(void);
 void timerclock(void);
 
 void gettime(time_t *seconds, uint32_t *nanoseconds);
@@ -70,8 +75,6 @@ void getinterval(time_t secs1, uint32_t nsecs,
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
- *
- *  this will be more efficient than clocknap() for longer sleeps
  */
 void clocksleep(int seconds);
 
@@ -35,6 +35,14 @@
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
+/*
+ * Load averages (the number of threads running or ready to run,
+ * decayed over 1, 5 and 15 minutes) are fixed point numbers with
+ * LOADAVG_FSCALE standing for 1.0.
+ */
+#define LOADAVG_NAVG	3
+#define LOADAVG_FSHIFT	11
+#define LOADAVG_FSCALE	(1 << LOADAVG_FSHIFT)
 
 /*
  * Per-cpu structure
@@ -59,7 +67,13 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadcache; /* Dead threads kept for reuse */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	unsigned c_tickspan;		/* Hardclocks per timer interrupt */
+	bool c_intruser;		/* Interrupt came from user mode */
+	unsigned c_busyticks;		/* Hardclocks spent running threads */
+	unsigned c_idleticks;		/* Hardclocks spent idle */
+	unsigned c_loadavg[LOADAVG_NAVG]; /* Load averages; see clock.c */
 
 	/*
 	 * Accessed by other cpus.
@@ -68,6 +82,20 @@ struct cpu {
 	bool c_isidle;			/* True if this cpu is idle */
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
+	unsigned c_migrated_in;		/* Threads moved here */
+	unsigned c_migrated_out;	/* Threads moved away */
+	unsigned c_edf_util;		/* EDF reservations, thousandths */
+	unsigned c_edf_misses;		/* EDF deadlines missed here */
+	unsigned c_vtime;		/* Fair-share virtual time */
+	unsigned c_boostepoch;		/* MLFQ epoch of its last boost */
+
+	/*
+	 * Accessed by other cpus.
+	 * Lock-free: threads woken by other cpus, pushed with
+	 * compare-and-swap and linked through t_wakenext. Holds a
+	 * struct thread pointer. See thread_make_runnable.
+	 */
+	volatile spinlock_data_t c_wakeups;
 
 	/*
 	 * Accessed by other cpus.
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+/*
+ * Futexes: sleep and wake keyed on a user address, so user-level
+ * locks only need the kernel when they're contended.
+ *
+ * Waiters are kept in a fixed hash table of buckets keyed by
+ * (address space, user address). Each bucket has a lock, which is
+ * held while checking the user word, so a wake can't slip in between
+ * the check and the sleep, and a wait channel to sleep on.
+ */
+
+#include <kern/futex.h>
+
+struct addrspace;
+
+/* Call once during system startup to allocate the hash table. */
+void futex_bootstrap(void);
+
+/*
+ * Sleep on UADDR in AS if the word there is VAL. Returns EAGAIN if
+ * it isn't, and EINTR without sleeping if the current process is
+ * exiting.
+ */
+int futex_wait(struct addrspace *as, userptr_t uaddr, int val);
+
+/* Wake up to MAX threads sleeping on UADDR in AS; returns how many. */
+unsigned futex_wake(struct addrspace *as, userptr_t uaddr, unsigned max);
+
+/* Wake every thread sleeping on any address in AS. */
+void futex_wakeall(struct addrspace *as);
+
+#endif /* _FUTEX_H_ */
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_EDF_H_
+#define _KERN_EDF_H_
+
+/*
+ * Earliest-deadline-first scheduling, through the sched_edf() system
+ * call.
+ *
+ * An EDF thread is promised ep_budget milliseconds of cpu time in
+ * every period of ep_period milliseconds, and runs ahead of all
+ * ordinary threads until it has had it. Times are rounded up to whole
+ * clock ticks. It is a deadline miss if a period ends before the
+ * thread has said (with EDF_WAIT) that it's done.
+ */
+
+/* Operations */
+#define EDF_SET		0	/* Set the caller's period and budget */
+#define EDF_GET		1	/* Get the caller's parameters and misses */
+#define EDF_WAIT	2	/* Done; sleep until the next period */
+
+struct edf_params {
+	unsigned ep_period;	/* ms; 0 for an ordinary thread */
+	unsigned ep_budget;	/* ms of cpu per period */
+	unsigned ep_misses;	/* deadlines missed (EDF_GET only) */
+};
+
+#endif /* _KERN_EDF_H_ */
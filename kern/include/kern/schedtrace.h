@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SCHEDTRACE_H_
+#define _KERN_SCHEDTRACE_H_
+
+/*
+ * Scheduler event trace records, as returned by the schedtrace()
+ * system call.
+ *
+ * Each cpu logs what its scheduler does into a ring buffer of these.
+ * Threads are identified by the kernel address of their thread
+ * structure, which is only meaningful as an identifier. Times are in
+ * cpu cycles since boot, as counted by the cpu that logged the event.
+ */
+
+/* Event types (ste_type) */
+#define STE_SWITCH	1	/* cpu switched from ste_thread to ste_arg */
+#define STE_READY	2	/* ste_thread queued to run on cpu ste_arg */
+#define STE_SLEEP	3	/* ste_thread blocked on wait channel ste_arg */
+#define STE_WAKE	4	/* ste_thread woken from wait channel ste_arg */
+#define STE_MIGRATE	5	/* ste_thread moved from cpu ste_arg to ste_arg2 */
+#define STE_IPI		6	/* interrupt ste_arg2 sent to cpu ste_arg */
+#define STE_LOST	7	/* ste_arg events overwritten before reading */
+#define STE_MISS	8	/* ste_thread missed a deadline by ste_arg ticks */
+
+/* For STE_SWITCH, ste_arg2 says why the old thread stopped running */
+#define STE_YIELDED	1	/* still runnable */
+#define STE_BLOCKED	2	/* went to sleep */
+#define STE_EXITED	3	/* exited */
+
+struct schedtrace_event {
+	__u64 ste_time;		/* when */
+	__u32 ste_thread;	/* thread concerned, or 0 */
+	__u32 ste_arg;		/* depends on type */
+	__u32 ste_arg2;		/* depends on type */
+	__u16 ste_type;		/* STE_* */
+	__u16 ste_cpu;		/* cpu that logged it */
+};
+
+/* Operations for schedtrace() */
+#define SCHEDTRACE_OFF	0	/* stop tracing */
+#define SCHEDTRACE_ON	1	/* start tracing */
+#define SCHEDTRACE_READ	2	/* drain events into a buffer */
+
+
+#endif /* _KERN_SCHEDTRACE_H_ */
@@ -86,7 +86,7 @@
 //#define SYS_sigaltstack 33
 //                              (resource tracking and usage)
 //#define SYS_wait4      34
-//#define SYS_getrusage  35
+#define SYS_getrusage    35
 //                              (resource limits)
 //#define SYS_getrlimit  36
 //#define SYS_setrlimit  37
@@ -197,6 +197,22 @@
 #define SYS_reboot       119
 //#define SYS___sysctl   120
 
+//                              -- Scheduling --
+#define SYS_schedtrace   121
+
+//                              -- Threads --
+#define SYS___threadfork 122
+#define SYS_threadexit   123
+#define SYS_threadjoin   124
+#define SYS_futex        125
+
+//                              (scheduling classes)
+#define SYS_sched_edf    126
+#define SYS_sched_setshare 127
+
+//                              -- Process creation --
+#define SYS_spawn        128
+
 /*CALLEND*/
 
 
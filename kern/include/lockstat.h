@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics.
+ *
+ * With the lockstat option, spinlocks, locks and semaphores keep
+ * counts of how often they are acquired, how often the acquirer had
+ * to wait, and how long it waited and (for spinlocks and locks) held
+ * the lock. Times are in cpu cycles. Statistics are kept per name:
+ * all locks or semaphores created with the same name share one
+ * record, and spinlocks, which have no names, are named after the
+ * source line that initialized them.
+ *
+ * Without the option none of this is compiled in.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+#include <spinlock.h>
+
+#define LOCKSTAT_NAMELEN 40
+
+struct lockstat {
+	char ls_name[LOCKSTAT_NAMELEN];
+	volatile spinlock_data_t ls_lock;	/* protects the counts */
+	unsigned ls_acquires;		/* times acquired */
+	unsigned ls_contended;		/* times the acquirer had to wait */
+	uint64_t ls_waitcycles;		/* total time spent waiting */
+	uint64_t ls_maxwait;		/* longest single wait */
+	uint64_t ls_holdcycles;		/* total time held */
+	bool ls_printed;		/* scratch for lockstat_print */
+};
+
+/*
+ * Find (or make) the record for NAME. Never fails: if the table is
+ * full, a catch-all record is returned.
+ */
+struct lockstat *lockstat_get(const char *name);
+
+/*
+ * Current time in cycles, for measuring waits and holds. Each cpu
+ * has its own clock, so this only measures time on one cpu; that's
+ * enough for spinlocks, whose holders can't move. Locks and
+ * semaphores can sleep and wake up elsewhere, so they note the cpu
+ * too (lockstat_cpu) and use lockstat_since, which gives 0 for a time
+ * that began on another cpu, or that would come out negative.
+ */
+uint64_t lockstat_now(void);
+unsigned lockstat_cpu(void);
+uint64_t lockstat_since(uint64_t start, unsigned startcpu);
+
+/* Count an acquisition, and a release after holding for HOLD cycles. */
+void lockstat_acquired(struct lockstat *ls, bool contended, uint64_t wait);
+void lockstat_released(struct lockstat *ls, uint64_t hold);
+
+/* Print the N records with the most time spent waiting; clear all. */
+void lockstat_print(unsigned n);
+void lockstat_reset(void);
+
+#endif /* OPT_LOCKSTAT */
+
+#endif /* _LOCKSTAT_H_ */
@@ -52,6 +52,17 @@ void mainbus_interrupt(struct trapframe *);
 /* XXX this interface is not adequately MI */
 size_t mainbus_ramsize(void);
 
+/*
+ * Program the current cpu's timer to interrupt at the end of the
+ * Nth hardclock period from the last one, and return how many whole
+ * periods have passed since the last one. (Low-level.)
+ */
+void mainbus_settimer(unsigned hardclocks);
+unsigned mainbus_timer_elapsed(void);
+
+/* Cycles since boot, as counted by the current cpu. (Low-level.) */
+uint64_t mainbus_cycles(void);
+
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
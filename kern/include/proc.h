@@ -50,12 +50,34 @@ struct semaphore;
 #if OPT_A2
 struct lock;
 struct cv;
+/*
+ * Bookkeeping for each user thread started with threadfork, kept in
+ * its process's p_uthreads until it is joined. The process's first
+ * thread doesn't have one.
+ */
+struct uthread {
+	int ut_tid;			/* Thread id, for threadjoin */
+	bool ut_exited;			/* Has called threadexit */
+	int ut_status;			/* Its threadexit status */
+	int ut_stackslot;		/* Its user stack; see addrspace.h */
+};
+
 struct Proc {
 	pid_t parent_pid;
 	pid_t child_pid;
 	bool dead;
+	bool reaped;		/* a waitpid has collected exit_code */
+	int waiters;		/* parent's threads in waitpid on it */
 	int exit_code;
+	struct cv *exit_cv;	/* broadcast (under waitLock) when child dies */
+	struct cpuusage usage;	/* child's total, with its children, once dead */
+	struct Proc *hash_next;	/* next in its process table bucket */
+	struct Proc *sib_next;	/* next on the parent's p_children */
+	struct Proc **sib_prev;	/* what points at us on p_children */
 };
+
+/* Process table buckets; child_pid modulo this picks one. */
+#define PT_HASHSIZE 128
 #endif
 
 /*
@@ -84,7 +106,42 @@ struct proc {
 #if OPT_A2
 	/* add more material here as needed */
 	pid_t p_pid;
+
+	/*
+	 * Multithreaded processes. p_exiting and p_exitstatus are
+	 * protected by p_lock; the user thread table by p_ulock, which
+	 * also serializes thread stack setup in the address space.
+	 *
+	 * Once p_exiting is set, the other threads leave as they head
+	 * back to user mode. proc_exit wakes those blocked in threadjoin,
+	 * futex_wait, nanosleep or waitpid so they can; a thread blocked
+	 * anywhere else in the kernel (a console read, say) holds the
+	 * exit up until what it's waiting for happens.
+	 */
+	bool p_exiting;			/* _exit called; all threads go */
+	int p_exitstatus;		/* waitpid status, once exiting */
+	struct lock *p_ulock;
+	struct cv *p_ucv;		/* signalled when a thread exits */
+	struct array *p_uthreads;	/* struct uthread */
+	int p_nexttid;			/* Next thread id to hand out */
+	struct Proc *p_children;	/* Our children's table entries */
 #endif
+
+	/*
+	 * Accounting, protected by p_lock: the usage of threads that
+	 * have left the process, and of children it has waited for.
+	 */
+	struct cpuusage p_usage;
+	struct cpuusage p_cusage;
+
+	/*
+	 * Fair share (see thread.c): tickets, and the pass, which goes
+	 * up by p_stride for every tick the process's threads run.
+	 * Protected by p_lock.
+	 */
+	unsigned p_tickets;
+	unsigned p_stride;
+	unsigned p_pass;
 };
 
 /* This is the process structure for the kernel and for kernel-only threads. */
@@ -96,24 +153,28 @@ extern struct semaphore *no_proc_sem;
 #endif // UW
 
 #if OPT_A2
-//extern
-struct lock *pidLock;
-//static volatile pid_t pid_counter;
-struct array *PTArray;
-extern struct cv *waitCV;
+extern struct rwlock *ptLock;
 extern struct lock *waitLock;
 
-struct Proc * findParentProc(pid_t targetPid);
+int pid_alloc(pid_t *retval);
+void pid_free(pid_t pid);
+
 struct Proc * findChildProc(pid_t targetPid);
-void addToProcTable(struct Proc *table);
+void addToProcTable(struct proc *parent, struct Proc *table);
 void removeFromProcTable(pid_t targetPid);
-unsigned int getIndex(pid_t targetPid);
+void removeChildProcs(struct proc *parent);
 
 #endif
 
 /* Call once during system startup to allocate data structures. */
 void proc_bootstrap(void);
 
+/* Set a process's fair-share tickets, 1 to SHARE_MAX. */
+void proc_setshare(struct proc *proc, unsigned tickets);
+
+/* Total usage of all of a process's threads, past and present. */
+void proc_getusage(struct proc *proc, struct cpuusage *usage);
+
 /* Create a fresh process for use by runprogram(). */
 struct proc *proc_create_runprogram(const char *name);
 
@@ -126,6 +187,12 @@ int proc_addthread(struct proc *proc, struct thread *t);
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/*
+ * Detach a thread from its process unless it is the last one there.
+ * Returns true if it was detached.
+ */
+bool proc_remthread_unlesslast(struct thread *t);
+
 /* Fetch the address space of the current process. */
 struct addrspace *curproc_getas(void);
 
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SCHEDTRACE_H_
+#define _SCHEDTRACE_H_
+
+/*
+ * Scheduler event tracing.
+ *
+ * While tracing is on, the scheduler logs context switches, wakeups,
+ * sleeps, migrations and IPIs into a per-cpu ring buffer (see
+ * <kern/schedtrace.h> for the record format). Each ring is only
+ * written by its own cpu, with interrupts off, so logging takes no
+ * locks. When a ring fills up the oldest events are overwritten; the
+ * reader is told how many it missed.
+ *
+ * While tracing is off, each trace point costs one test of
+ * schedtrace_enabled.
+ */
+
+#include <kern/schedtrace.h>
+
+/* Events kept per cpu */
+#define SCHEDTRACE_RINGSIZE	1024
+
+/* Largest cpu number that gets a ring */
+#define SCHEDTRACE_MAXCPUS	32
+
+extern volatile bool schedtrace_enabled;
+
+/* Allocate cpu CPUNUM's ring. Called from cpu_create. */
+void schedtrace_cpu_init(unsigned cpunum);
+
+/* Log an event on the current cpu. Use SCHEDTRACE instead. */
+void schedtrace_emit(unsigned type, const void *thread,
+		     uint32_t arg, uint32_t arg2);
+
+#define SCHEDTRACE(type, thread, arg, arg2) \
+	do { \
+		if (schedtrace_enabled) { \
+			schedtrace_emit(type, thread, arg, arg2); \
+		} \
+	} while (0)
+
+/* Turn tracing on or off. Turning it on discards old events. */
+void schedtrace_start(void);
+void schedtrace_stop(void);
+
+/*
+ * Move up to MAX unread events, oldest first within each cpu, into
+ * BUF. Returns the number moved. An STE_LOST record is included for
+ * each cpu that overwrote events before they were read.
+ */
+unsigned schedtrace_drain(struct schedtrace_event *buf, unsigned max);
+
+/* Drain and print events on the console. */
+void schedtrace_dump(void);
+
+
+#endif /* _SCHEDTRACE_H_ */
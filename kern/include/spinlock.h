@@ -36,6 +36,10 @@
  */
 
 #include <cdefs.h>
+#include "opt-ticketlock.h"
+#include "opt-lockstat.h"
+
+struct lockstat;	/* from <lockstat.h> */
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -53,16 +57,43 @@
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
+ *
+ * With the ticketlock option, a cpu wanting the lock takes a ticket
+ * from lk_next and waits until lk_serving reaches it, so the lock is
+ * granted in FIFO order. Otherwise it is a test-and-set lock and the
+ * order is whoever gets there first.
  */
 struct spinlock {
+#if OPT_TICKETLOCK
+	volatile spinlock_data_t lk_next; /* Next ticket to hand out. */
+	volatile spinlock_data_t lk_serving; /* Ticket now holding. */
+#else
 	volatile spinlock_data_t lk_lock; /* The memory word where we spin. */
+#endif
 	struct cpu *lk_holder;		/* CPU holding this lock. */
+#if OPT_LOCKSTAT
+	const char *lk_file;		/* Where initialized, for lockstat. */
+	int lk_line;
+	struct lockstat *lk_stat;	/* Statistics, found on first use. */
+	uint64_t lk_stamp;		/* When acquired. */
+#endif
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#if OPT_TICKETLOCK
+#define SPINLOCK_WORDS_INITIALIZER \
+	SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER
+#else
+#define SPINLOCK_WORDS_INITIALIZER	SPINLOCK_DATA_INITIALIZER
+#endif
+#if OPT_LOCKSTAT
+#define SPINLOCK_INITIALIZER \
+	{ SPINLOCK_WORDS_INITIALIZER, NULL, __FILE__, __LINE__, NULL, 0 }
+#else
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_WORDS_INITIALIZER, NULL }
+#endif
 
 /*
  * Spinlock functions.
@@ -71,15 +102,24 @@ struct spinlock {
  * cleanup	Opposite of init. Lock must be unlocked.
  *
  * acquire	Get the lock, spinning as necessary. Also disables interrupts.
+ * tryacquire	Get the lock only if it's free right now. Returns true, with
+ *		interrupts disabled as for acquire, on success.
  * release	Release the lock. May re-enable interrupts.
  *
  * do_i_hold	Check if the current CPU holds the lock.
  */
 
+#if OPT_LOCKSTAT
+/* Record where each spinlock is initialized, to name it by. */
+void spinlock_init_at(struct spinlock *lk, const char *file, int line);
+#define spinlock_init(lk) spinlock_init_at(lk, __FILE__, __LINE__)
+#else
 void spinlock_init(struct spinlock *lk);
+#endif
 void spinlock_cleanup(struct spinlock *lk);
 
 void spinlock_acquire(struct spinlock *lk);
+bool spinlock_tryacquire(struct spinlock *lk);
 void spinlock_release(struct spinlock *lk);
 
 bool spinlock_do_i_hold(struct spinlock *lk);
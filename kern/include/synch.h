@@ -36,6 +36,7 @@
 
 
 #include <spinlock.h>
+#include "opt-lockstat.h"
 
 /*
  * Dijkstra-style semaphore.
@@ -48,6 +49,9 @@ struct semaphore {
 	struct wchan *sem_wchan;
 	struct spinlock sem_lock;
         volatile int sem_count;
+#if OPT_LOCKSTAT
+	struct lockstat *sem_stat;
+#endif
 };
 
 struct semaphore *sem_create(const char *name, int initial_count);
@@ -78,6 +82,14 @@ struct lock {
 	struct spinlock lk_lock;
 	volatile bool lk_held;
 	struct thread *lk_owner;
+	unsigned lk_waiters;		/* threads asleep on lk_wchan */
+	struct thread *lk_donors;	/* waiters, linked by t_nextdonor */
+	struct lock *lk_nextheld;	/* link for owner's t_heldlocks */
+#if OPT_LOCKSTAT
+	struct lockstat *lk_stat;
+	uint64_t lk_stamp;		/* when acquired */
+	unsigned lk_stampcpu;		/* and on which cpu's clock */
+#endif
 };
 
 struct lock *lock_create(const char *name);
@@ -86,9 +98,14 @@ void lock_acquire(struct lock *);
 /*
  * Operations:
  *    lock_acquire - Get the lock. Only one thread can hold the lock at the
- *                   same time.
+ *                   same time. If the holder is running on another
+ *                   cpu, spin for a short while before going to
+ *                   sleep. While a thread waits, it lends its
+ *                   priority to the holder, and on through any chain
+ *                   of locks the holder is itself waiting for.
  *    lock_release - Free the lock. Only the thread holding the lock may do
- *                   this.
+ *                   this. Any priority lent through this lock is
+ *                   given back.
  *    lock_do_i_hold - Return true if the current thread holds the lock; 
  *                   false otherwise.
  *
@@ -141,4 +158,53 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of threads may hold the lock in shared (read) mode at
+ * once, or one thread in exclusive (write) mode. If the lock is
+ * created with writer preference, new readers are held off while a
+ * writer is waiting, so that a steady stream of readers cannot starve
+ * writers out; otherwise readers get in whenever there is no writer.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+struct rwlock {
+	char *rw_name;
+	struct spinlock rw_lock;
+	struct wchan *rw_readwchan;	/* readers wait here */
+	struct wchan *rw_writewchan;	/* writers wait here */
+	unsigned rw_readers;		/* number of readers in */
+	unsigned rw_writerswaiting;	/* number of writers waiting */
+	struct thread *rw_writer;	/* writer in, if any */
+	bool rw_writerpref;
+};
+
+struct rwlock *rwlock_create(const char *name, bool writerpref);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read   - Get the lock in shared mode.
+ *    rwlock_release_read   - Give up shared mode.
+ *    rwlock_acquire_write  - Get the lock in exclusive mode.
+ *    rwlock_release_write  - Give up exclusive mode.
+ *    rwlock_downgrade      - Turn exclusive mode into shared mode, without
+ *                            letting another writer in in between. The
+ *                            lock must then be released with
+ *                            rwlock_release_read.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                            the lock in exclusive mode. (There is no
+ *                            equivalent for shared mode, as readers are
+ *                            not tracked individually.)
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+void rwlock_downgrade(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
@@ -57,14 +57,26 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t user_req, userptr_t user_rem);
+int sys_sched_edf(int op, userptr_t params);
+int sys_sched_setshare(int tickets, int32_t *retval);
+int sys_schedtrace(int op, userptr_t buf, size_t buflen, int32_t *retval);
 
 #ifdef UW
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
 void sys__exit(int exitcode);
+void proc_exit(int status);
+void proc_leave(int status);
+int sys___threadfork(userptr_t entry, userptr_t arg, int32_t *retval);
+void sys_threadexit(int status);
+int sys_threadjoin(int tid, userptr_t status);
+int sys_futex(userptr_t uaddr, int op, int val, int32_t *retval);
+int sys_getrusage(int who, userptr_t usage);
 int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 int sys_fork(struct trapframe *tf, pid_t *retval);
 int sys_execv(char *program, char **args);
+int sys_spawn(char *program, char **args, pid_t *retval);
 #endif // UW
 
 #endif /* _SYSCALL_H_ */
@@ -60,6 +60,8 @@ int threadtest3(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int rwlocktest(int, char **);
+int workqueuetest(int, char **);
 
 #ifdef UW
 /* Another thread and synchronization test */
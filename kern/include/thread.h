@@ -41,11 +41,24 @@
 #include <threadlist.h>
 
 struct cpu;
+struct uthread;
+struct timeout;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
 
 
+/* Number of scheduler priority levels; level 0 is the highest. */
+#define MLFQ_NLEVELS 3
+
+/*
+ * Fair-share tickets per process: the default, and the most allowed.
+ * A process's stride is STRIDE1 divided by its tickets.
+ */
+#define SHARE_DEFAULT	100
+#define SHARE_MAX	1000
+#define STRIDE1		(1 << 16)
+
 /* Size of kernel stacks; must be power of 2 */
 #define STACK_SIZE 4096
 
@@ -56,6 +69,17 @@ struct cpu;
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
 
+/*
+ * Cpu time, in hardclocks, and context switch counts. Kept for each
+ * thread, and summed up for processes (see getrusage).
+ */
+struct cpuusage {
+	unsigned cu_utime;		/* Ticks in user mode */
+	unsigned cu_stime;		/* Ticks in the kernel */
+	unsigned cu_nvcsw;		/* Switches away by blocking */
+	unsigned cu_nivcsw;		/* Switches away still runnable */
+};
+
 /* States a thread can be in. */
 typedef enum {
 	S_RUN,		/* running */
@@ -72,6 +96,7 @@ struct thread {
 	 */
 	char *t_name;			/* Name of this thread */
 	const char *t_wchan_name;	/* Name of wait channel, if sleeping */
+	struct wchan *t_wchan;		/* Channel it's on; under its wc_lock */
 	threadstate_t t_state;		/* State this thread is in */
 
 	/*
@@ -82,7 +107,55 @@ struct thread {
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
+	bool t_pinned;			/* Never migrate off t_cpu */
+	struct thread *t_wakenext;	/* Link in t_cpu's c_wakeups */
 	struct proc *t_proc;		/* Process thread belongs to */
+	struct cpu *t_lastcpu;		/* CPU thread last ran on */
+	unsigned t_lastrun;		/* t_lastcpu's c_hardclocks then */
+
+	/*
+	 * Scheduler fields.
+	 *
+	 * t_priority is the thread's level in the multi-level feedback
+	 * queue; 0 is the highest. t_quantum is the length of its
+	 * current time slice in hardclocks, and t_ticks counts the
+	 * hardclocks charged against it so far. t_epoch records the
+	 * last priority boost the thread has seen. See schedule().
+	 *
+	 * The remaining fields implement priority donation through
+	 * locks (see synch.c) and are protected by the donation
+	 * spinlock there, except t_heldlocks, which only the thread
+	 * itself touches. t_donated is MLFQ_NLEVELS if nothing has
+	 * been donated.
+	 */
+	int t_priority;			/* MLFQ level */
+	unsigned t_quantum;		/* Length of current quantum */
+	unsigned t_ticks;		/* Ticks used of current quantum */
+	unsigned t_epoch;		/* Last boost epoch seen */
+	int t_donated;			/* Best level lent by lock waiters */
+	struct lock *t_waitlock;	/* Lock we're blocked on, if any */
+	struct lock *t_heldlocks;	/* Locks we hold */
+	struct thread *t_nextdonor;	/* Link for t_waitlock's waiters */
+
+	/*
+	 * Earliest-deadline-first reservation, if t_edf_period is
+	 * nonzero; see thread_edf_set(). Times are in hardclocks of
+	 * t_cpu, which an EDF thread never leaves.
+	 */
+	unsigned t_edf_period;		/* Length of each period */
+	unsigned t_edf_budget;		/* Cpu time promised per period */
+	unsigned t_edf_used;		/* Budget used this period */
+	unsigned t_edf_deadline;	/* End of current period */
+	bool t_edf_done;		/* Finished this period's work */
+	unsigned t_edf_misses;		/* Periods ended with work left */
+
+	unsigned t_pass;		/* Process's pass when queued */
+
+	/*
+	 * Accounting. Ticks are charged by hardclock() and switches
+	 * counted by thread_switch(), both on the thread's own cpu.
+	 */
+	struct cpuusage t_usage;
 
 	/*
 	 * Interrupt state fields.
@@ -106,6 +179,11 @@ struct thread {
 	 */
 
 	/* add more here as needed */
+	struct uthread *t_uthread;	/* threadfork bookkeeping, if any */
+
+	/* Interruptible timed sleep (see timeout.h); under the wheel lock */
+	struct timeout *t_sleepto;	/* its timeout, while asleep */
+	bool t_nosleep;			/* interrupted: don't sleep again */
 };
 
 /*
@@ -139,11 +217,40 @@ void thread_shutdown(void);
  * thread structure for the new thread is not returned; it is not in
  * general safe to refer to it as the new thread may exit and
  * disappear at any time without notice.
+ *
+ * The new thread starts on whichever cpu has the least to do.
  */
 int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Like thread_fork, but the new thread starts on cpu number CPUNUM
+ * and stays there: the load balancer never moves it. For per-cpu
+ * service threads.
+ */
+int thread_fork_pinned(const char *name, struct proc *proc, unsigned cpunum,
+                       void (*func)(void *, unsigned long),
+                       void *data1, unsigned long data2);
+
+/*
+ * Like thread_fork, but the caller says where the new thread goes:
+ * CPUNUM is a cpu number, or THREAD_ANYCPU for the least busy cpu
+ * (what thread_fork does), or THREAD_AWAYCPU for the least busy cpu
+ * other than the current one if there's one as good. The latter is
+ * for when the caller is going to keep running. If PINNED is set the
+ * thread stays on that cpu, as with thread_fork_pinned.
+ */
+#define THREAD_ANYCPU	(-1)
+#define THREAD_AWAYCPU	(-2)
+int thread_fork_placed(const char *name, struct proc *proc,
+                       int cpunum, bool pinned,
+                       void (*func)(void *, unsigned long),
+                       void *data1, unsigned long data2);
+
+/* Number of cpus in the system (once thread_start_cpus has run). */
+unsigned thread_numcpus(void);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -162,11 +269,64 @@ void thread_yield(void);
  */
 void schedule(void);
 
+/*
+ * Charge a clock tick to the current thread, and yield if its time
+ * slice is used up or a higher-priority thread is waiting. Called
+ * from the timer interrupt.
+ */
+void thread_timeslice(void);
+
+/*
+ * Effective scheduling priority of a thread: its MLFQ level, or the
+ * level donated to it by threads waiting on its locks if that is
+ * better.
+ */
+int thread_priority(struct thread *t);
+
+/* Move a thread to a feedback queue level and start a new quantum. */
+void thread_setlevel(struct thread *t, int level);
+
+/*
+ * Tell the scheduler a thread's effective priority has improved, so
+ * it can be moved forward if it is sitting on a run queue.
+ */
+void thread_reprioritize(struct thread *t);
+
 /*
  * Potentially migrate ready threads to other CPUs. Called from the
  * timer interrupt.
  */
 void thread_consider_migration(void);
 
+/*
+ * Migration tuning: threads that haven't run for this many hardclocks
+ * are considered to have lost their cache state and are preferred for
+ * migration; and a cpu only sheds load when it has more than this many
+ * threads beyond its share.
+ */
+extern unsigned thread_migrate_coldticks;
+extern unsigned thread_migrate_hysteresis;
+
+/* Print the tunables and the per-cpu migration counts. */
+void thread_print_migrations(void);
+
+/* Add the counts in FROM to TO. */
+void cpuusage_add(struct cpuusage *to, const struct cpuusage *from);
+
+/* Print each cpu's busy and idle time and load averages. */
+void thread_print_cpustats(void);
+
+/*
+ * Earliest-deadline-first scheduling for the current thread:
+ * thread_edf_set reserves BUDGET hardclocks in every PERIOD (0 to
+ * cancel), subject to admission control; thread_edf_wait ends the
+ * current period's work and sleeps until the next one. Both return
+ * error codes. thread_print_edf shows per-cpu reservations and
+ * deadline misses.
+ */
+int thread_edf_set(unsigned period, unsigned budget);
+int thread_edf_wait(void);
+void thread_print_edf(void);
+
 
 #endif /* _THREAD_H_ */
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TIMEOUT_H_
+#define _TIMEOUT_H_
+
+/*
+ * Timeouts: call a function once a given number of timer ticks have
+ * gone by. The timer ticks every LT_GRANULARITY usec (see
+ * kern/dev/lamebus/ltimer.h), in timerclock().
+ *
+ * Pending timeouts are kept in a hierarchical timing wheel indexed by
+ * absolute expiry time, so each tick only looks at the timeouts that
+ * are due then (plus, once every 64 ticks, moving a slot's worth of
+ * later ones down a level).
+ *
+ * The function is called from the timer interrupt, so it must not
+ * sleep. Once it has been called the timeout is no longer pending, and
+ * it is not touched again, so the function may free or reuse it.
+ */
+
+struct thread;
+
+struct timeout {
+	struct timeout *to_next;	/* Link in wheel slot */
+	struct timeout **to_pprev;	/* Back link, for cancelling */
+	unsigned to_expire;		/* Tick at which to fire */
+	bool to_pending;		/* True while in the wheel */
+	void (*to_func)(void *);	/* Function to call */
+	void *to_arg;			/* Argument for to_func */
+};
+
+/* Set up the wheel. Called once at boot. */
+void timeout_bootstrap(void);
+
+/* Advance the wheel by one tick, running whatever is due. */
+void timeout_tick(void);
+
+/* Current time in ticks since boot (wraps around). */
+unsigned timeout_now(void);
+
+/* Convert an interval to ticks, rounding up. */
+unsigned timeout_ticks(time_t secs, uint32_t nsecs);
+
+/*
+ * Prepare a timeout to call FUNC(ARG).
+ */
+void timeout_init(struct timeout *to, void (*func)(void *), void *arg);
+
+/*
+ * Arrange for the timeout to fire TICKS ticks from now. Must not
+ * already be pending.
+ */
+void timeout_add(struct timeout *to, unsigned ticks);
+
+/*
+ * Take a pending timeout out of the wheel. Returns false if it wasn't
+ * pending, which includes the case where it has just fired and its
+ * function may still be running on another cpu.
+ */
+bool timeout_cancel(struct timeout *to);
+
+/*
+ * Put the current thread to sleep for TICKS ticks. Only the sleeping
+ * thread is woken when its time is up.
+ */
+void timeout_sleep(unsigned ticks);
+
+/*
+ * Interruptible timed sleep, so a process can exit while one of its
+ * threads is in nanosleep.
+ *
+ * timeout_sleep_intr is timeout_sleep, except that it returns EINTR
+ * early if timeout_stopsleep is called on the thread, before or
+ * during the sleep; after that the thread's timed sleeps all return
+ * EINTR straight away.
+ *
+ * timeout_stopsleep returns true if it cancelled a sleep in progress.
+ * The thread then stays asleep, and can't go away, until it is passed
+ * to timeout_wakesleeper, which the caller must do promptly, but may
+ * do after letting go of locks it held while finding the thread.
+ */
+int timeout_sleep_intr(unsigned ticks);
+bool timeout_stopsleep(struct thread *t);
+void timeout_wakesleeper(struct thread *t);
+
+
+#endif /* _TIMEOUT_H_ */
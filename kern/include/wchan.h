@@ -36,6 +36,7 @@
 
 
 struct wchan; /* Opaque */
+struct thread; /* from <thread.h> */
 
 /*
  * Create a wait channel. Use NAME as a symbolic name for the channel.
@@ -81,5 +82,19 @@ void wchan_sleep(struct wchan *wc);
 void wchan_wakeone(struct wchan *wc);
 void wchan_wakeall(struct wchan *wc);
 
+/*
+ * Wake up one particular thread, which must be sleeping on the wait
+ * channel. The queue should not already be locked.
+ */
+void wchan_wakethread(struct wchan *wc, struct thread *target);
+
+/*
+ * Wake up the sleeper that would be scheduled first (earliest EDF
+ * deadline, then best priority, including donations); among equals,
+ * the one that has slept longest. The queue should not already be
+ * locked.
+ */
+void wchan_wakebest(struct wchan *wc);
+
 
 #endif /* _WCHAN_H_ */
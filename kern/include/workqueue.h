@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Work queues: run a function later, in a kernel thread, so the
+ * caller doesn't have to wait for it.
+ *
+ * Each work queue has one worker thread per cpu, pinned to that cpu.
+ * Work is queued on the cpu that queues it and run by that cpu's
+ * worker, in the order queued. Work items on different cpus run
+ * concurrently.
+ *
+ * The work function runs in thread context and may sleep. Once it
+ * has been called the item is no longer pending and is not touched
+ * again, so the function may free or requeue it.
+ *
+ * work_enqueue may be called from an interrupt handler.
+ */
+
+#include <spinlock.h>
+#include <timeout.h>
+
+struct workqueue;
+
+struct work {
+	struct work *w_next;		/* Link in worker's queue */
+	volatile spinlock_data_t w_pending; /* Queued, or waiting on delay */
+	void (*w_func)(void *);		/* Function to call */
+	void *w_arg;			/* Argument for w_func */
+	struct workqueue *w_wq;		/* Queue for delayed work */
+	struct timeout w_timeout;	/* Delay for delayed work */
+};
+
+/* Set up the system work queue. Called once at boot, after the cpus start. */
+void workqueue_bootstrap(void);
+
+/* General-purpose queue for deferred cleanup. */
+extern struct workqueue *system_wq;
+
+/*
+ * Make a work queue, with worker threads named NAME. Returns NULL
+ * if out of memory.
+ */
+struct workqueue *workqueue_create(const char *name);
+
+/*
+ * Run all the work still queued, stop the workers, and free the
+ * queue. There must be no delayed work outstanding.
+ */
+void workqueue_destroy(struct workqueue *wq);
+
+/*
+ * Prepare a work item to call FUNC(ARG).
+ */
+void work_init(struct work *w, void (*func)(void *), void *arg);
+
+/*
+ * Queue a work item. Returns false, and does nothing, if it is
+ * already pending.
+ */
+bool work_enqueue(struct workqueue *wq, struct work *w);
+
+/*
+ * Queue a work item once TICKS timer ticks (see timeout.h) have gone
+ * by. Returns false, and does nothing, if it is already pending.
+ */
+bool work_enqueue_delayed(struct workqueue *wq, struct work *w,
+			  unsigned ticks);
+
+/*
+ * Call FUNC(ARG) on the system work queue, using a work item
+ * allocated for the purpose. If that allocation fails, FUNC is called
+ * right away instead, so it always gets called.
+ */
+void work_defer(void (*func)(void *), void *arg);
+
+
+#endif /* _WORKQUEUE_H_ */
@@ -43,6 +43,9 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <bitmap.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
@@ -70,9 +73,11 @@ struct semaphore *no_proc_sem;
 #endif  // UW
 
 #if OPT_A2
-struct lock *pidLock;
-struct array *PTArray;
-struct cv *waitCV;
+static struct lock *pidLock;
+static struct bitmap *pidMap;	/* bit n set: pid PID_MIN+n is in use */
+static unsigned pidNext;	/* where pid_alloc looks first */
+static struct Proc *ptHash[PT_HASHSIZE];
+struct rwlock *ptLock;
 struct lock *waitLock;
 #endif
 
@@ -108,8 +113,37 @@ proc_create(const char *name)
 	proc->console = NULL;
 #endif // UW
 
+	bzero(&proc->p_usage, sizeof(proc->p_usage));
+	bzero(&proc->p_cusage, sizeof(proc->p_cusage));
+	proc->p_pass = 0;
+	proc_setshare(proc, SHARE_DEFAULT);
+
 #if OPT_A2
 	proc->p_pid = 1;
+	proc->p_exiting = false;
+	proc->p_exitstatus = 0;
+	proc->p_nexttid = 1;
+	proc->p_children = NULL;
+	proc->p_ulock = lock_create("p_ulock");
+	proc->p_ucv = cv_create("p_ucv");
+	proc->p_uthreads = array_create();
+	if (proc->p_ulock == NULL || proc->p_ucv == NULL ||
+	    proc->p_uthreads == NULL) {
+		if (proc->p_ulock != NULL) {
+			lock_destroy(proc->p_ulock);
+		}
+		if (proc->p_ucv != NULL) {
+			cv_destroy(proc->p_ucv);
+		}
+		if (proc->p_uthreads != NULL) {
+			array_destroy(proc->p_uthreads);
+		}
+		threadarray_cleanup(&proc->p_threads);
+		spinlock_cleanup(&proc->p_lock);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
 #endif
 	return proc;
 }
@@ -171,6 +205,17 @@ proc_destroy(struct proc *proc)
 	}
 #endif // UW
 
+#if OPT_A2
+	/* Records of threads nobody joined */
+	while (array_num(proc->p_uthreads) > 0) {
+		kfree(array_get(proc->p_uthreads, 0));
+		array_remove(proc->p_uthreads, 0);
+	}
+	array_destroy(proc->p_uthreads);
+	cv_destroy(proc->p_ucv);
+	lock_destroy(proc->p_ulock);
+#endif
+
 	threadarray_cleanup(&proc->p_threads);
 	spinlock_cleanup(&proc->p_lock);
 
@@ -219,11 +264,12 @@ proc_bootstrap(void)
 
 #if OPT_A2
   pidLock = lock_create("pidLock");
-  PTArray = array_create();
-  waitCV = cv_create("waitCV");
+  pidMap = bitmap_create(PID_MAX - PID_MIN + 1);
+  pidNext = 0;
+  ptLock = rwlock_create("ptLock", true);
   waitLock = lock_create("waitLock");
-  if(pidLock == NULL || PTArray == NULL  || waitCV == NULL  || waitLock == NULL ){
-  	panic("ERROR when creating pidLock/PTArray/waitLock/waitCV");
+  if(pidLock == NULL || pidMap == NULL || ptLock == NULL || waitLock == NULL ){
+  	panic("ERROR when creating pidLock/pidMap/ptLock/waitLock");
   }
 #endif
 }
@@ -332,6 +378,7 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+			cpuusage_add(&proc->p_usage, &t->t_usage);
 			spinlock_release(&proc->p_lock);
 			t->t_proc = NULL;
 			return;
@@ -342,6 +389,70 @@ proc_remthread(struct thread *t)
 	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
 }
 
+/*
+ * Remove a thread from its process, unless no other thread is left
+ * there. The check and the removal happen together under p_lock, so
+ * when several threads leave at once exactly one finds itself last.
+ */
+bool
+proc_remthread_unlesslast(struct thread *t)
+{
+	struct proc *proc;
+	unsigned i, num;
+
+	proc = t->t_proc;
+	KASSERT(proc != NULL);
+
+	spinlock_acquire(&proc->p_lock);
+	num = threadarray_num(&proc->p_threads);
+	if (num == 1) {
+		KASSERT(threadarray_get(&proc->p_threads, 0) == t);
+		spinlock_release(&proc->p_lock);
+		return false;
+	}
+	for (i=0; i<num; i++) {
+		if (threadarray_get(&proc->p_threads, i) == t) {
+			threadarray_remove(&proc->p_threads, i);
+			cpuusage_add(&proc->p_usage, &t->t_usage);
+			spinlock_release(&proc->p_lock);
+			t->t_proc = NULL;
+			return true;
+		}
+	}
+	spinlock_release(&proc->p_lock);
+	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
+}
+
+void
+proc_setshare(struct proc *proc, unsigned tickets)
+{
+	KASSERT(tickets > 0 && tickets <= SHARE_MAX);
+
+	spinlock_acquire(&proc->p_lock);
+	proc->p_tickets = tickets;
+	proc->p_stride = STRIDE1 / tickets;
+	spinlock_release(&proc->p_lock);
+}
+
+/*
+ * Add up the usage of PROC's threads: those that have left, whose
+ * counts are in p_usage, and those still there.
+ */
+void
+proc_getusage(struct proc *proc, struct cpuusage *usage)
+{
+	unsigned i, num;
+
+	spinlock_acquire(&proc->p_lock);
+	*usage = proc->p_usage;
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		cpuusage_add(usage,
+			     &threadarray_get(&proc->p_threads, i)->t_usage);
+	}
+	spinlock_release(&proc->p_lock);
+}
+
 /*
  * Fetch the address space of the current process. Caution: it isn't
  * refcounted. If you implement multithreaded processes, make sure to
@@ -384,57 +495,146 @@ curproc_setas(struct addrspace *newas)
 }
 
 #if OPT_A2
-struct Proc * findParentProc(pid_t targetPid){
-	struct Proc *ret = NULL;
-	unsigned int size = array_num(PTArray);
-	for(unsigned int i = 0; i < size; ++i){
-		struct Proc *tmp = array_get(PTArray, i);
-		if(tmp->parent_pid == targetPid){
-			ret = tmp;
-			break;
+/*
+ * Pids run from PID_MIN to PID_MAX and are handed out next-fit: the
+ * search starts just past the last pid given out, so a pid isn't
+ * reused until the rest of the range has had a turn. pidLock covers
+ * only the bitmap, never waitLock's bookkeeping.
+ *
+ * A pid is freed once nothing can name it any more: when its table
+ * entry is freed if the process had exited by then, otherwise when
+ * the process exits with no entry left (see proc_leave).
+ */
+int pid_alloc(pid_t *retval){
+	unsigned n = PID_MAX - PID_MIN + 1;
+	unsigned i, index;
+
+	lock_acquire(pidLock);
+	for (i = 0; i < n; i++) {
+		index = (pidNext + i) % n;
+		if (!bitmap_isset(pidMap, index)) {
+			bitmap_mark(pidMap, index);
+			pidNext = (index + 1) % n;
+			lock_release(pidLock);
+			*retval = PID_MIN + index;
+			return 0;
 		}
 	}
-	return ret;
+	lock_release(pidLock);
+	return ENPROC;
+}
+
+void pid_free(pid_t pid){
+	KASSERT(pid >= PID_MIN && pid <= PID_MAX);
+	lock_acquire(pidLock);
+	bitmap_unmark(pidMap, pid - PID_MIN);
+	lock_release(pidLock);
 }
+
+/*
+ * The process table is looked up far more often than it changes, so
+ * it is protected by a reader-writer lock, ptLock. The lookups only
+ * hold it while searching. The entries they return are only freed by
+ * removeFromProcTable and removeChildProcs, which are only called
+ * under waitLock, so a caller holding waitLock can keep using an entry
+ * afterwards. waitpid frees an entry once it has been reaped.
+ *
+ * Entries are hashed by child_pid, and each is also on its parent's
+ * p_children list, so finding a pid doesn't depend on how many
+ * processes there are, and an exiting parent only visits its own
+ * children.
+ *
+ * Each entry has its own exit_cv, so an exiting child wakes only its
+ * own parent's threads rather than every process blocked in waitpid.
+ */
+static struct Proc **ptBucket(pid_t targetPid){
+	return &ptHash[(unsigned)targetPid % PT_HASHSIZE];
+}
+
+/* Take an entry off its hash chain and its parent's list. */
+static void ptUnlink(struct Proc *target){
+	struct Proc **pp;
+
+	KASSERT(rwlock_do_i_hold_write(ptLock));
+	for (pp = ptBucket(target->child_pid); *pp != target;
+	     pp = &(*pp)->hash_next) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = target->hash_next;
+
+	*target->sib_prev = target->sib_next;
+	if (target->sib_next != NULL) {
+		target->sib_next->sib_prev = target->sib_prev;
+	}
+}
+
+static void ptFree(struct Proc *target){
+	if (target->dead) {
+		/* reaped; the pid can go round again */
+		pid_free(target->child_pid);
+	}
+	cv_destroy(target->exit_cv);
+	kfree(target);
+}
+
 struct Proc * findChildProc(pid_t targetPid){
-	struct Proc *ret = NULL;
-	unsigned int size = array_num(PTArray);
-	for(unsigned int i = 0; i < size; ++i){
-		struct Proc *tmp = array_get(PTArray, i);
-		if(tmp->child_pid == targetPid){
-			ret = tmp;
+	struct Proc *ret;
+	rwlock_acquire_read(ptLock);
+	for (ret = *ptBucket(targetPid); ret != NULL; ret = ret->hash_next) {
+		if (ret->child_pid == targetPid) {
 			break;
 		}
 	}
+	rwlock_release_read(ptLock);
 	return ret;
 }
-void addToProcTable(struct Proc *table){
-	if (PTArray == NULL) {
-		PTArray = array_create();
-		array_init(PTArray);
+void addToProcTable(struct proc *parent, struct Proc *table){
+	struct Proc **bucket = ptBucket(table->child_pid);
+
+	KASSERT(table->parent_pid == parent->p_pid);
+	rwlock_acquire_write(ptLock);
+	table->hash_next = *bucket;
+	*bucket = table;
+	table->sib_next = parent->p_children;
+	if (table->sib_next != NULL) {
+		table->sib_next->sib_prev = &table->sib_next;
 	}
-	array_add(PTArray, table, NULL);
+	table->sib_prev = &parent->p_children;
+	parent->p_children = table;
+	rwlock_release_write(ptLock);
 }
 void removeFromProcTable(pid_t targetPid){
-	struct Proc *target = findChildProc(targetPid);
-	unsigned int pos = getIndex(targetPid);
-	if(pos == array_num(PTArray)) return;
+	struct Proc *target;
+	rwlock_acquire_write(ptLock);
+	for (target = *ptBucket(targetPid); target != NULL;
+	     target = target->hash_next) {
+		if (target->child_pid == targetPid) {
+			ptUnlink(target);
+			break;
+		}
+	}
+	rwlock_release_write(ptLock);
 	if(target != NULL){
-		array_remove(PTArray, pos);
-		kfree(target);
+		ptFree(target);
 	}
 }
 
-// if pid is found, return the postion in the array
-// else return INT_MAX;
-unsigned int getIndex(pid_t targetPid){
-	unsigned int size = array_num(PTArray);
-	for(unsigned int i = 0; i < size; ++i){
-		struct Proc *pt = array_get(PTArray, i);
-		if(pt->child_pid == targetPid)
-			return i;
+// drop the entries of all of parent's children, dead or alive, when
+// it exits. the caller must hold waitLock.
+void removeChildProcs(struct proc *parent){
+	struct Proc *list;
+	KASSERT(lock_do_i_hold(waitLock));
+	rwlock_acquire_write(ptLock);
+	list = parent->p_children;
+	while (parent->p_children != NULL) {
+		ptUnlink(parent->p_children);
+	}
+	rwlock_release_write(ptLock);
+	while (list != NULL) {
+		struct Proc *next = list->sib_next;
+		ptFree(list);
+		list = next;
 	}
-	return size;
 }
 #endif
 
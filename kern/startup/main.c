@@ -43,6 +43,8 @@
 #include <current.h>
 #include <synch.h>
 #include <vm.h>
+#include <workqueue.h>
+#include <futex.h>
 #include <mainbus.h>
 #include <vfs.h>
 #include <device.h>
@@ -127,6 +129,8 @@ boot(void)
 	vm_bootstrap();
 	kprintf_bootstrap();
 	thread_start_cpus();
+	workqueue_bootstrap();
+	futex_bootstrap();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
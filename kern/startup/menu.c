@@ -42,9 +42,15 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <schedtrace.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+#include <lockstat.h>
+#endif
 
 /*
  * In-kernel menu and command dispatcher.
@@ -410,6 +416,117 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for printing migration statistics, and optionally setting
+ * the migration tunables.
+ */
+static
+int
+cmd_migstats(int nargs, char **args)
+{
+	if (nargs != 1 && nargs != 3) {
+		kprintf("Usage: mig [coldticks hysteresis]\n");
+		return EINVAL;
+	}
+
+	if (nargs == 3) {
+		thread_migrate_coldticks = atoi(args[1]);
+		thread_migrate_hysteresis = atoi(args[2]);
+	}
+	thread_print_migrations();
+
+	return 0;
+}
+
+/*
+ * Command for scheduler event tracing. With no argument, stops
+ * tracing (so printing doesn't generate more events) and prints
+ * what was collected.
+ */
+static
+int
+cmd_trace(int nargs, char **args)
+{
+	if (nargs > 2) {
+		kprintf("Usage: trace [on | off]\n");
+		return EINVAL;
+	}
+
+	if (nargs == 2) {
+		if (!strcmp(args[1], "on")) {
+			schedtrace_start();
+		}
+		else if (!strcmp(args[1], "off")) {
+			schedtrace_stop();
+		}
+		else {
+			kprintf("Usage: trace [on | off]\n");
+			return EINVAL;
+		}
+		return 0;
+	}
+
+	schedtrace_stop();
+	schedtrace_dump();
+	return 0;
+}
+
+/*
+ * Command for printing per-cpu busy and idle time and load averages.
+ */
+static
+int
+cmd_cpustats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_print_cpustats();
+	return 0;
+}
+
+/*
+ * Command for printing EDF reservations and deadline misses.
+ */
+static
+int
+cmd_edfstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_print_edf();
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for printing (or clearing) lock contention statistics.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	unsigned n = 10;
+
+	if (nargs > 2) {
+		kprintf("Usage: lockstat [count | reset]\n");
+		return EINVAL;
+	}
+
+	if (nargs == 2) {
+		if (!strcmp(args[1], "reset")) {
+			lockstat_reset();
+			return 0;
+		}
+		n = atoi(args[1]);
+	}
+	lockstat_print(n);
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -480,6 +597,8 @@ static const char *testmenu[] = {
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[sy4] Rwlock test                   ",
+	"[wq]  Work queue test               ",
 #ifdef UW
 	"[uw1] UW lock test          (1)     ",
 	"[uw2] UW vmstats test       (3)     ",
@@ -520,6 +639,13 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[mig] Thread migration stats        ",
+	"[cpu] Cpu time and load averages    ",
+	"[trace] Scheduler event trace       ",
+	"[edf] EDF reservations and misses   ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock contention stats    ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -577,6 +703,13 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "mig",	cmd_migstats },
+	{ "cpu",	cmd_cpustats },
+	{ "trace",	cmd_trace },
+	{ "edf",	cmd_edfstats },
+#if OPT_LOCKSTAT
+	{ "lockstat",	cmd_lockstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -594,6 +727,8 @@ static struct {
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "sy4",	rwlocktest },
+	{ "wq",		workqueuetest },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 	{ "uw2",	uwvmstatstest },
@@ -3,6 +3,8 @@
 #include <kern/unistd.h>
 #include <kern/wait.h>
 #include <kern/fcntl.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 #include <lib.h>
 #include <syscall.h>
 #include <current.h>
@@ -14,14 +16,99 @@
 #include <limits.h>
 #include <synch.h>
 #include <vfs.h>
+#include <workqueue.h>
+#include <clock.h>
+#include <futex.h>
+#include <timeout.h>
 #include "opt-A2.h"
 
-static volatile pid_t pid_counter = 2;
-
-  /* this implementation of sys__exit does not do anything with the exit code */
-  /* this needs to be fixed to get exit() and waitpid() working properly */
+/* Work function for tearing down an exited process's address space. */
+static
+void
+exit_as_destroy(void *as)
+{
+  as_destroy(as);
+}
 
 void sys__exit(int exitcode) {
+  proc_exit(_MKWAIT_EXIT(exitcode));
+}
+
+/*
+ * Get the current process's other threads out of nanosleep. One at a
+ * time, since they can't be woken while p_lock is held.
+ */
+static void proc_stopsleeps(struct proc *p) {
+  struct thread *t;
+  unsigned i;
+
+  do {
+    t = NULL;
+    spinlock_acquire(&p->p_lock);
+    for (i = 0; i < threadarray_num(&p->p_threads); i++) {
+      struct thread *u = threadarray_get(&p->p_threads, i);
+      if (u != curthread && timeout_stopsleep(u)) {
+        t = u;
+        break;
+      }
+    }
+    spinlock_release(&p->p_lock);
+    if (t != NULL) {
+      timeout_wakesleeper(t);
+    }
+  } while (t != NULL);
+}
+
+/*
+ * End the whole current process, from any of its threads. The first
+ * caller picks the exit status (a waitpid status); other threads
+ * notice p_exiting on their way back to user mode and come through
+ * here too (see mips_trap), and the last one out tears the process
+ * down in proc_leave.
+ */
+void proc_exit(int status) {
+  struct proc *p = curproc;
+  bool others;
+
+  spinlock_acquire(&p->p_lock);
+  if (!p->p_exiting) {
+    p->p_exiting = true;
+    p->p_exitstatus = status;
+  }
+  others = threadarray_num(&p->p_threads) > 1;
+  spinlock_release(&p->p_lock);
+
+  if (others) {
+    /* Get threads blocked in threadjoin or futex_wait moving. */
+    lock_acquire(p->p_ulock);
+    cv_broadcast(p->p_ucv, p->p_ulock);
+    lock_release(p->p_ulock);
+    futex_wakeall(p->p_addrspace);
+
+    /* And those in nanosleep, or in waitpid (which check p_exiting). */
+    proc_stopsleeps(p);
+    lock_acquire(waitLock);
+    /* (another of our threads may be in fork, adding to p_children) */
+    rwlock_acquire_read(ptLock);
+    for (struct Proc *c = p->p_children; c != NULL; c = c->sib_next) {
+      if (c->waiters > 0) {
+        cv_broadcast(c->exit_cv, waitLock);
+      }
+    }
+    rwlock_release_read(ptLock);
+    lock_release(waitLock);
+  }
+
+  proc_leave(status);
+}
+
+/*
+ * Take the current thread out of its process for good. If other
+ * threads are left, that's all. The last thread out destroys the
+ * process, which exits with STATUS unless proc_exit already chose
+ * one.
+ */
+void proc_leave(int status) {
   //parent dead -> burn myself down
   //parent not dead -> tell parent that i'm dying (leave a message before i die)
   //child dead -> burn child down
@@ -30,21 +117,36 @@ void sys__exit(int exitcode) {
   struct addrspace *as;
   struct proc *p = curproc;
 
+  if (proc_remthread_unlesslast(curthread)) {
+    thread_exit();
+  }
+
+  spinlock_acquire(&p->p_lock);
+  if (!p->p_exiting) {
+    p->p_exiting = true;
+    p->p_exitstatus = status;
+  }
+  spinlock_release(&p->p_lock);
+
 //#if OPT_A2
   lock_acquire(waitLock);
   struct Proc * child = findChildProc(curproc->p_pid);
   if(child != NULL){
-    child->exit_code = _MKWAIT_EXIT(exitcode);
+    /* leave our cpu usage, and our children's, for the parent */
+    proc_getusage(p, &child->usage);
+    spinlock_acquire(&p->p_lock);
+    cpuusage_add(&child->usage, &p->p_cusage);
+    spinlock_release(&p->p_lock);
+    child->exit_code = p->p_exitstatus;
     child->dead = true;
+    cv_broadcast(child->exit_cv, waitLock);
   }
-  cv_broadcast(waitCV, waitLock);
-
-  struct Proc * parent = findParentProc(curproc->p_pid);
-  while(parent != NULL){
-    pid_t temp = parent->child_pid;
-    removeFromProcTable(temp);
-    parent = findParentProc(curproc->p_pid);
+  else if (p->p_pid >= PID_MIN) {
+    /* our parent is gone, so nobody will reap us: free the pid now */
+    pid_free(p->p_pid);
   }
+
+  removeChildProcs(p);
   lock_release(waitLock);
 
 // #else
@@ -52,7 +154,7 @@ void sys__exit(int exitcode) {
 //      an unused variable 
 //   (void)exitcode;
 // #endif
-  DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
+  DEBUG(DB_SYSCALL,"Syscall: _exit(0x%x)\n",p->p_exitstatus);
 
   KASSERT(curproc->p_addrspace != NULL);
   as_deactivate();
@@ -62,9 +164,13 @@ void sys__exit(int exitcode) {
    * come back we'll be calling as_activate on a
    * half-destroyed address space. This tends to be
    * messily fatal.
+   *
+   * Freeing all its pages can take a while, and nothing is waiting
+   * on it, so hand it to a worker thread and let the exit (and the
+   * parent's waitpid) go ahead.
    */
   as = curproc_setas(NULL);
-  as_destroy(as);
+  work_defer(exit_as_destroy, as);
 
   /* detach this thread from its process */
   /* note: curproc cannot be used after this call  */
@@ -76,7 +182,7 @@ void sys__exit(int exitcode) {
   
   thread_exit();
   /* thread_exit() does not return, so we should never get here */
-  panic("return from thread_exit in sys_exit\n");
+  panic("return from thread_exit in proc_leave\n");
 }
 
 //#if OPT_A2
@@ -110,7 +216,7 @@ sys_waitpid(pid_t pid,
   if(children == NULL) {
     result = ESRCH;
   }
-  if(children->parent_pid != curproc->p_pid){ 
+  else if(children->parent_pid != curproc->p_pid || children->reaped){ 
     result = ECHILD;
   }
   if (result > 0) {
@@ -118,13 +224,35 @@ sys_waitpid(pid_t pid,
     return(result);
   }
 
-  while(!children->dead)
-    cv_wait(waitCV, waitLock);
+  children->waiters++;
+  while(!children->dead && !curproc->p_exiting)
+    cv_wait(children->exit_cv, waitLock);
+  children->waiters--;
 
-  //zombie
-  exitstatus = children->exit_code;
+  //zombie: only one of our threads gets to collect it
+  if(!children->dead){
+    //we're exiting instead; leave it for the parent-exit cleanup
+    result = EINTR;
+  }
+  else if(children->reaped){
+    result = ECHILD;
+  }
+  else{
+    children->reaped = true;
+    exitstatus = children->exit_code;
+    spinlock_acquire(&curproc->p_lock);
+    cpuusage_add(&curproc->p_cusage, &children->usage);
+    spinlock_release(&curproc->p_lock);
+  }
+  //the last one out frees the entry, and with it the pid
+  if(children->dead && children->waiters == 0){
+    removeFromProcTable(pid);
+  }
 
   lock_release(waitLock);
+  if (result > 0) {
+    return(result);
+  }
 //#else
   /* for now, just pretend the exitstatus is 0 */
 //  exitstatus = 0;
@@ -137,56 +265,133 @@ sys_waitpid(pid_t pid,
   return(0);
 }
 
-int sys_fork(struct trapframe *tf, pid_t *retval){
-  KASSERT(curproc != NULL);
-  //Create process structure for child process
+/* Convert hardclocks to a struct timeval. */
+static void ticks_to_timeval(unsigned ticks, struct timeval *tv) {
+  tv->tv_sec = ticks / HZ;
+  tv->tv_usec = (ticks % HZ) * (1000000 / HZ);
+}
+
+/* handler for getrusage() system call: cpu time and context switches */
+int
+sys_getrusage(int who, userptr_t usage)
+{
+  struct cpuusage cu;
+  struct rusage ru;
+
+  switch (who) {
+    case RUSAGE_SELF:
+      proc_getusage(curproc, &cu);
+      break;
+    case RUSAGE_CHILDREN:
+      spinlock_acquire(&curproc->p_lock);
+      cu = curproc->p_cusage;
+      spinlock_release(&curproc->p_lock);
+      break;
+    case RUSAGE_THREAD:
+      cu = curthread->t_usage;
+      break;
+    default:
+      return EINVAL;
+  }
+
+  bzero(&ru, sizeof(ru));
+  ticks_to_timeval(cu.cu_utime, &ru.ru_utime);
+  ticks_to_timeval(cu.cu_stime, &ru.ru_stime);
+  ru.ru_nvcsw = cu.cu_nvcsw;
+  ru.ru_nivcsw = cu.cu_nivcsw;
+  return copyout(&ru, usage, sizeof(ru));
+}
+
+/*
+ * Make a new child of the current process, for fork or spawn. It gets
+ * a pid, an entry in the process table and the parent's fair share,
+ * but no address space or threads yet. If it never gets to run, hand
+ * it back with child_abandon.
+ */
+static int child_create(struct proc **retproc){
   struct proc *cur_proc = curproc;
   struct proc *child_proc = proc_create_runprogram(cur_proc->p_name);
   //if a process wasn't created
   if(child_proc == NULL){
-    kfree(cur_proc->p_name);
     return ENPROC;
   }
-  DEBUG(DB_SYSCALL, "Sys_fork: new process created.\n");
 
+  //child gets the same fair share, starting where the parent is
+  proc_setshare(child_proc, cur_proc->p_tickets);
+  child_proc->p_pass = cur_proc->p_pass;
 
-  //Create and copy address space (and data) from parent to child
-  int err = as_copy(curproc_getas(), &(child_proc->p_addrspace));
-  //if address space is not assigned
+  //Assign PID to child process 
+  int err = pid_alloc(&child_proc->p_pid);
   if(err){
-    kfree(cur_proc->p_name);
     proc_destroy(child_proc);
-    return ENOMEM;
+    return err;
   }
-  DEBUG(DB_SYSCALL, "Sys_fork: new addrspace created.\n");
-  
-  //Assign PID to child process 
-  lock_acquire(pidLock);
-  child_proc->p_pid = pid_counter++;
-  lock_release(pidLock);
 
   //create the parent/child relationship
   struct Proc *newproc = kmalloc(sizeof(struct Proc));
   if(newproc == NULL){
-    kfree(cur_proc->p_name);
-    as_destroy(child_proc->p_addrspace);
+    pid_free(child_proc->p_pid);
+    proc_destroy(child_proc);
+    return ENOMEM;
+  }
+  newproc->exit_cv = cv_create("exit_cv");
+  if(newproc->exit_cv == NULL){
+    kfree(newproc);
+    pid_free(child_proc->p_pid);
     proc_destroy(child_proc);
+    return ENOMEM;
   }
-  lock_acquire(pidLock);
-  newproc->parent_pid = curproc->p_pid;
+  newproc->parent_pid = cur_proc->p_pid;
   newproc->child_pid = child_proc->p_pid;
   newproc->dead = false;
+  newproc->reaped = false;
+  newproc->waiters = 0;
   newproc->exit_code = 0;
-  lock_release(pidLock);
-  addToProcTable(newproc);
+  bzero(&newproc->usage, sizeof(newproc->usage));
+  addToProcTable(cur_proc, newproc);
+
+  *retproc = child_proc;
+  return 0;
+}
+
+/* Undo child_create for a child with no threads. */
+static void child_abandon(struct proc *child_proc){
+  lock_acquire(waitLock);
+  removeFromProcTable(child_proc->p_pid);
+  lock_release(waitLock);
+  pid_free(child_proc->p_pid);
+  /* this also destroys its address space, if it got one */
+  proc_destroy(child_proc);
+}
+
+int sys_fork(struct trapframe *tf, pid_t *retval){
+  KASSERT(curproc != NULL);
+  //Create process structure for child process
+  struct proc *child_proc;
+  int err = child_create(&child_proc);
+  if(err){
+    return err;
+  }
+  DEBUG(DB_SYSCALL, "Sys_fork: new process created.\n");
+
+  //Create and copy address space (and data) from parent to child,
+  //with only our own thread stack, if we're on one
+  int keepslot = -1;
+  if(curthread->t_uthread != NULL){
+    keepslot = curthread->t_uthread->ut_stackslot;
+  }
+  err = as_copy(curproc_getas(), keepslot, &(child_proc->p_addrspace));
+  //if address space is not assigned
+  if(err){
+    child_abandon(child_proc);
+    return ENOMEM;
+  }
+  DEBUG(DB_SYSCALL, "Sys_fork: new addrspace created.\n");
 
   //create trapframe
   struct trapframe *ntf = kmalloc(sizeof(struct trapframe));
   if(ntf == NULL){
-    kfree(cur_proc->p_name);
-    as_destroy(child_proc->p_addrspace);
-    kfree(newproc);
-    proc_destroy(child_proc);
+    child_abandon(child_proc);
     return ENOMEM;
   }
   memcpy(ntf, tf, sizeof(struct trapframe));
@@ -194,14 +399,13 @@ int sys_fork(struct trapframe *tf, pid_t *retval){
 
 
   //Create thread for child process
-  //int error = thread_fork(curthread->t_name, child_proc, &enter_forked_process, ntf, 1);
-  int error = thread_fork(curthread->t_name, child_proc, &enter_forked_process, ntf, 1);
+  //the parent goes on running here, so start the child on another cpu
+  //if one is at least as free
+  int error = thread_fork_placed(curthread->t_name, child_proc, THREAD_AWAYCPU,
+                                 false, &enter_forked_process, ntf, 1);
   if(error){
-    kfree(cur_proc->p_name);
-    kfree(newproc);
-    as_destroy(child_proc->p_addrspace);
     kfree(ntf);
-    proc_destroy(child_proc);
+    child_abandon(child_proc);
     return error;
   }
   DEBUG(DB_SYSCALL, "Sys_fork: new fork created.\n");
@@ -211,74 +415,120 @@ int sys_fork(struct trapframe *tf, pid_t *retval){
   return 0;
 }
 
-int sys_execv(char *program, char **args){
-  if(program == NULL) return EFAULT;
-  (void) args;
-
-  struct addrspace *newaddr;
-  struct addrspace *oldaddr = curproc->p_addrspace;
-  struct vnode *v;
-  vaddr_t entrypoint, stackptr;
-  int result = 0;
-
-  //allocate space for path and copy the path
-  size_t namelen = strlen(program) + 1;
-  char *newpath = kmalloc(sizeof(char*) * namelen);
-  if(newpath == NULL) return ENOMEM;
-
-  result = copyinstr((userptr_t)program, newpath, namelen, NULL);
-  if(result) return result;
+/*
+ * The argument block has to fit on the new stack, as well as in
+ * ARG_MAX.
+ */
+#define EXEC_ARGMAX (ARG_MAX < AS_STACKARGMAX ? ARG_MAX : AS_STACKARGMAX)
+
+/*
+ * The parts of execv that spawn shares. exec_copyin brings the program
+ * path and arguments into the kernel; exec_load builds a new address
+ * space from them for the current process and switches to it; and
+ * exec_free drops the kernel copies.
+ *
+ * The arguments go into one EXEC_ARGMAX arena, laid out as they will be
+ * on the new stack: argc+1 pointer slots, then the strings. While in
+ * the kernel the slots hold each string's offset in the arena, and
+ * exec_load turns them into user addresses and copies the whole block
+ * out at once.
+ */
+struct execargs {
+  char *path;
+  char *buf;	/* EXEC_ARGMAX bytes: argv slots, then strings */
+  size_t len;	/* bytes of buf in use */
+  int argc;
+};
+
+static void exec_free(struct execargs *ea){
+  kfree(ea->buf);
+  kfree(ea->path);
+}
 
-  //count number of arguments
-  int argcount = 0;
-  while(args[argcount] != NULL){
-    if(strlen(args[argcount]) > 1024) {
-      kfree(newpath);
-      return E2BIG;
-    }
-    ++argcount;
-  }
-  if(argcount > 32) {
-    kfree(newpath);
-    return E2BIG;
+static int exec_copyin(char *program, char **args, struct execargs *ea){
+  vaddr_t *slots;
+  vaddr_t uaddr = (vaddr_t)args;
+  size_t nslots = 0, maxslots = EXEC_ARGMAX / sizeof(vaddr_t);
+  size_t chunk, got;
+  int result;
+
+  ea->path = kmalloc(PATH_MAX);
+  ea->buf = kmalloc(EXEC_ARGMAX);
+  if(ea->path == NULL || ea->buf == NULL) {
+    result = ENOMEM;
+    goto fail;
   }
+  result = copyinstr((const_userptr_t)program, ea->path, PATH_MAX, NULL);
+  if(result) goto fail;
 
-  //copy argurment into kernel
-  char **kernargs = kmalloc(sizeof(char**) * (argcount + 1));
-  for(int i = 0; i < argcount; ++i){
-    size_t arglen = strlen(args[i]) + 1;
-    kernargs[i] = kmalloc(sizeof(char*) * arglen);
-    result = copyinstr((userptr_t)args[i], kernargs[i], arglen, NULL);
+  /*
+   * The pointer array, up to its NULL. Copy a page's worth at a time:
+   * we can't tell where it ends, and reading past the page it ends in
+   * might fault.
+   */
+  slots = (vaddr_t *)ea->buf;
+  do {
+    if(nslots == maxslots) {
+      result = E2BIG;
+      goto fail;
+    }
+    chunk = (PAGE_SIZE - (uaddr & ~PAGE_FRAME)) / sizeof(vaddr_t);
+    if(chunk == 0) chunk = 1;	/* misaligned; copyin will complain */
+    if(chunk > maxslots - nslots) chunk = maxslots - nslots;
+    result = copyin((const_userptr_t)uaddr, &slots[nslots],
+                    chunk * sizeof(vaddr_t));
+    if(result) goto fail;
+    uaddr += chunk * sizeof(vaddr_t);
+    for(got = 0; got < chunk && slots[nslots] != 0; got++) {
+      nslots++;
+    }
+  } while(got == chunk);
+  ea->argc = nslots;
+  ea->len = (nslots + 1) * sizeof(vaddr_t);
+
+  //then the strings, packed after the slots
+  for(int i = 0; i < ea->argc; ++i){
+    result = copyinstr((const_userptr_t)slots[i], ea->buf + ea->len,
+                       EXEC_ARGMAX - ea->len, &got);
     if(result) {
-      kfree(newpath);
-      for(int j = 0; j <= i; j++){
-        kfree(kernargs[j]);
-      }
-      kfree(kernargs);
-      return result;
+      if(result == ENAMETOOLONG) result = E2BIG;
+      goto fail;
     }
+    slots[i] = ea->len;
+    ea->len += got;
   }
-  kernargs[argcount] = NULL;
+  slots[ea->argc] = 0;
+  return 0;
+
+ fail:
+  kfree(ea->buf);
+  kfree(ea->path);
+  return result;
+}
+
+/*
+ * On success the current process is running in the new address space,
+ * and the old one is returned in *oldaddrp for the caller to destroy;
+ * on failure the old one is still in place.
+ */
+static int exec_load(struct execargs *ea, struct addrspace **oldaddrp,
+                     vaddr_t *entrypointp, vaddr_t *stackptrp){
+  struct addrspace *newaddr;
+  struct addrspace *oldaddr = curproc_getas();
+  struct vnode *v;
+  vaddr_t entrypoint, stackptr;
+  vaddr_t *slots = (vaddr_t *)ea->buf;
+  int result = 0;
 
   //open the program file
-  result = vfs_open(newpath, O_RDONLY, 0, &v);
+  result = vfs_open(ea->path, O_RDONLY, 0, &v);
   if (result) {
-    kfree(newpath);
-    for(int j = 0; j < argcount; j++){
-      kfree(kernargs[j]);
-    }
-    kfree(kernargs);
     return result;
   }
   
   // Create a new address space.
   newaddr = as_create();
   if (newaddr ==NULL) {
-    kfree(newpath);
-    for(int j = 0; j < argcount; j++){
-      kfree(kernargs[j]);
-    }
-    kfree(kernargs);
     vfs_close(v);
     return ENOMEM;
   }
@@ -289,64 +539,56 @@ int sys_execv(char *program, char **args){
 
   // Load the executable.
   result = load_elf(v, &entrypoint);
-  if (result) {
-    kfree(newpath);
-    for(int j = 0; j < argcount; j++){
-      kfree(kernargs[j]);
-    }
-    kfree(kernargs);
-    // p_addrspace will go away when curproc is destroyed
-    vfs_close(v);
-    curproc_setas(oldaddr);
-    return result;
-  }
-
   // Done with the file now.
   vfs_close(v);
+  if (result) {
+    goto fail;
+  }
 
   // Define the user stack in the address space
   result = as_define_stack(newaddr, &stackptr);
   if (result) {
-    kfree(newpath);
-    for(int j = 0; j < argcount; j++){
-      kfree(kernargs[j]);
-    }
-    kfree(kernargs);
-    // p_addrspace will go away when curproc is destroyed
-    curproc_setas(oldaddr);
-    return result;
+    goto fail;
   }
 
-  //copy the arguments into the user stack
-  while(stackptr % 8 != 0)
-    --stackptr;
+  //copy the argument block onto the user stack, argv at the bottom
+  stackptr -= ROUNDUP(ea->len, 8);
+  for(int i = 0; i < ea->argc; ++i){
+    slots[i] += stackptr;
+  }
+  result = copyout(ea->buf, (userptr_t)stackptr, ea->len);
+  if(result) {
+    goto fail;
+  }
 
-  int size = sizeof(vaddr_t) * (argcount + 1); 
-  vaddr_t *ptrtable = kmalloc(size);
+  *oldaddrp = oldaddr;
+  *entrypointp = entrypoint;
+  *stackptrp = stackptr;
+  return 0;
 
-  for(int i = argcount - 1; i >= 0; --i){
-    size_t arg_i_len = strlen(kernargs[i]) + 1;
-    //first find the start of the stack pointer
-    stackptr -= ROUNDUP( arg_i_len * sizeof(char *), 8);
-    //then copy the argument to stack pointer
-    result = copyoutstr(kernargs[i], (userptr_t)stackptr, arg_i_len, NULL);
-    if(result) {
-      for(int j = 0; j < argcount; j++){
-        kfree(kernargs[j]);
-      }
-      kfree(kernargs);
-      return result;
-    }
-    //then store this pointer to the ptrtable
-    ptrtable[i] = stackptr;
-  }
-  ptrtable[argcount] = (vaddr_t)NULL;
+ fail:
+  curproc_setas(oldaddr);
+  as_activate();
+  as_destroy(newaddr);
+  return result;
+}
+
+int sys_execv(char *program, char **args){
+  struct execargs ea;
+  struct addrspace *oldaddr;
+  vaddr_t entrypoint, stackptr;
+  int result;
+
+  /* The other threads would be left running in a destroyed address space. */
+  if(threadarray_num(&curproc->p_threads) > 1) return EBUSY;
 
-  //copy the pointers (to arguments) into the user stack
-  while(stackptr % 8 != 0)
-    --stackptr;
-  stackptr -= size; 
-  copyout(ptrtable, (userptr_t)stackptr, size);
+  result = exec_copyin(program, args, &ea);
+  if(result) return result;
+
+  result = exec_load(&ea, &oldaddr, &entrypoint, &stackptr);
+  int argcount = ea.argc;
+  exec_free(&ea);
+  if(result) return result;
 
   //delete old address space
   as_destroy(oldaddr);
@@ -359,4 +601,85 @@ int sys_execv(char *program, char **args){
   return EINVAL;
 }
 
+/*
+ * spawn: fork and execv in one, without copying the parent's address
+ * space only to throw it away. The parent copies in the arguments and
+ * makes the child; the child loads the program into its own, empty,
+ * address space and tells the parent how that went before going to
+ * user mode, so a bad program fails the spawn rather than the child.
+ */
+struct spawnargs {
+  struct execargs sa_exec;
+  struct semaphore *sa_done;	/* V'd by the child once it has loaded */
+  int sa_result;
+};
+
+static void
+enter_spawned_process(void *data1, unsigned long data2)
+{
+  struct spawnargs *sa = data1;
+  struct addrspace *oldaddr;
+  vaddr_t entrypoint, stackptr;
+  int argcount = sa->sa_exec.argc;
+
+  (void)data2;
+
+  sa->sa_result = exec_load(&sa->sa_exec, &oldaddr, &entrypoint, &stackptr);
+  if(sa->sa_result){
+    /* leave the process empty for the parent to take back */
+    proc_remthread(curthread);
+    V(sa->sa_done);
+    thread_exit();
+  }
+  KASSERT(oldaddr == NULL);
+
+  /* sa lives on the parent's stack; it's gone once we V */
+  V(sa->sa_done);
+  enter_new_process(argcount, (userptr_t)stackptr, stackptr, entrypoint);
+
+  // enter_new_process does not return.
+  panic("enter_new_process returned\n");
+}
+
+int sys_spawn(char *program, char **args, pid_t *retval){
+  struct spawnargs sa;
+  struct proc *child_proc;
+  pid_t pid;
+  int err;
+
+  err = exec_copyin(program, args, &sa.sa_exec);
+  if(err) return err;
+  sa.sa_done = sem_create("spawn", 0);
+  if(sa.sa_done == NULL){
+    exec_free(&sa.sa_exec);
+    return ENOMEM;
+  }
+
+  err = child_create(&child_proc);
+  if(err) goto out;
+  pid = child_proc->p_pid;
+
+  err = thread_fork_placed(curthread->t_name, child_proc, THREAD_AWAYCPU,
+                           false, &enter_spawned_process, &sa, 0);
+  if(err){
+    child_abandon(child_proc);
+    goto out;
+  }
+
+  P(sa.sa_done);
+  err = sa.sa_result;
+  if(err){
+    child_abandon(child_proc);
+    goto out;
+  }
+  DEBUG(DB_SYSCALL, "Sys_spawn: %s started as pid %d.\n", sa.sa_exec.path,
+        (int)pid);
+  *retval = pid;
+
+ out:
+  sem_destroy(sa.sa_done);
+  exec_free(&sa.sa_exec);
+  return err;
+}
+
 //#endif
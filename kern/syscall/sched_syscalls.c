@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/schedtrace.h>
+#include <kern/edf.h>
+#include <lib.h>
+#include <clock.h>
+#include <current.h>
+#include <thread.h>
+#include <proc.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include <schedtrace.h>
+
+/* Events copied out per pass */
+#define SCHEDTRACE_CHUNK	64
+
+/* Longest EDF period accepted, in ms */
+#define EDF_MAXPERIOD	60000
+
+/* Milliseconds to hardclocks, rounding up, and back. */
+#define MS_TO_HARDCLOCKS(ms)	DIVROUNDUP((ms) * HZ, 1000)
+#define HARDCLOCKS_TO_MS(hc)	((hc) * 1000 / HZ)
+
+/*
+ * Earliest-deadline-first scheduling for the calling thread; see
+ * <kern/edf.h>.
+ */
+int
+sys_sched_edf(int op, userptr_t params)
+{
+	struct thread *cur = curthread;
+	struct edf_params ep;
+	int result;
+
+	switch (op) {
+	    case EDF_SET:
+		result = copyin(params, &ep, sizeof(ep));
+		if (result) {
+			return result;
+		}
+		if (ep.ep_period > EDF_MAXPERIOD ||
+		    ep.ep_budget > ep.ep_period) {
+			return EINVAL;
+		}
+		return thread_edf_set(MS_TO_HARDCLOCKS(ep.ep_period),
+				      MS_TO_HARDCLOCKS(ep.ep_budget));
+	    case EDF_GET:
+		ep.ep_period = HARDCLOCKS_TO_MS(cur->t_edf_period);
+		ep.ep_budget = HARDCLOCKS_TO_MS(cur->t_edf_budget);
+		ep.ep_misses = cur->t_edf_misses;
+		return copyout(&ep, params, sizeof(ep));
+	    case EDF_WAIT:
+		return thread_edf_wait();
+	}
+	return EINVAL;
+}
+
+/*
+ * Give the calling process TICKETS tickets' worth of cpu time
+ * relative to other processes (see thread.c). Returns the old number.
+ */
+int
+sys_sched_setshare(int tickets, int32_t *retval)
+{
+	if (tickets <= 0 || tickets > SHARE_MAX) {
+		return EINVAL;
+	}
+	*retval = curproc->p_tickets;
+	proc_setshare(curproc, tickets);
+	return 0;
+}
+
+/*
+ * Turn scheduler tracing on or off, or drain the trace into a user
+ * buffer. For SCHEDTRACE_READ, returns the number of bytes stored,
+ * which is a whole number of struct schedtrace_event; 0 means there
+ * was nothing left.
+ */
+int
+sys_schedtrace(int op, userptr_t buf, size_t buflen, int32_t *retval)
+{
+	struct schedtrace_event *kbuf;
+	size_t done, max;
+	unsigned n;
+	int result;
+
+	switch (op) {
+	    case SCHEDTRACE_OFF:
+		schedtrace_stop();
+		return 0;
+	    case SCHEDTRACE_ON:
+		schedtrace_start();
+		return 0;
+	    case SCHEDTRACE_READ:
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	kbuf = kmalloc(SCHEDTRACE_CHUNK * sizeof(*kbuf));
+	if (kbuf == NULL) {
+		return ENOMEM;
+	}
+
+	done = 0;
+	while (1) {
+		max = (buflen - done) / sizeof(*kbuf);
+		if (max > SCHEDTRACE_CHUNK) {
+			max = SCHEDTRACE_CHUNK;
+		}
+		n = schedtrace_drain(kbuf, max);
+		if (n == 0) {
+			break;
+		}
+		result = copyout(kbuf, (userptr_t)((char *)buf + done),
+				 n * sizeof(*kbuf));
+		if (result) {
+			/* Whatever was drained into kbuf is lost. */
+			kfree(kbuf);
+			return result;
+		}
+		done += n * sizeof(*kbuf);
+	}
+
+	kfree(kbuf);
+	*retval = done;
+	return 0;
+}
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * System calls for multithreaded user processes.
+ *
+ * All the threads of a process share its address space; each one
+ * made by __threadfork gets its own user stack from
+ * as_define_threadstack and a struct uthread record (see proc.h) that
+ * threadjoin uses to collect its exit status. The original thread of
+ * a process has no record and can't be joined.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/wait.h>
+#include <lib.h>
+#include <array.h>
+#include <copyinout.h>
+#include <synch.h>
+#include <current.h>
+#include <proc.h>
+#include <thread.h>
+#include <addrspace.h>
+#include <futex.h>
+#include <syscall.h>
+
+/*
+ * What a new user thread needs to get going; handed from
+ * sys___threadfork to uthread_enter.
+ */
+struct uthread_start {
+	vaddr_t us_entry;
+	vaddr_t us_stack;
+	struct uthread *us_uthread;
+};
+
+/*
+ * Find the record for thread TID. Call with p_ulock held.
+ */
+static
+struct uthread *
+uthread_find(struct proc *p, int tid, unsigned *index_ret)
+{
+	struct uthread *ut;
+	unsigned i, num;
+
+	num = array_num(p->p_uthreads);
+	for (i=0; i<num; i++) {
+		ut = array_get(p->p_uthreads, i);
+		if (ut->ut_tid == tid) {
+			if (index_ret != NULL) {
+				*index_ret = i;
+			}
+			return ut;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * First thing a new user thread runs, in the kernel.
+ */
+static
+void
+uthread_enter(void *data1, unsigned long arg)
+{
+	struct uthread_start *us = data1;
+	vaddr_t entry, stack;
+
+	curthread->t_uthread = us->us_uthread;
+	entry = us->us_entry;
+	stack = us->us_stack;
+	kfree(us);
+
+	if (curproc->p_exiting) {
+		/* Too late; the process is going away. */
+		proc_exit(0);
+	}
+
+	/* enter_new_process passes ARG through as the first argument. */
+	enter_new_process((int)arg, NULL, stack, entry);
+	panic("enter_new_process returned\n");
+}
+
+/*
+ * Start a new thread in the current process, running ENTRY(ARG) on a
+ * stack of its own. Returns its thread id.
+ */
+int
+sys___threadfork(userptr_t entry, userptr_t arg, int32_t *retval)
+{
+	struct proc *p = curproc;
+	struct uthread_start *us;
+	struct uthread *ut;
+	unsigned index;
+	int slot, result;
+	vaddr_t stack;
+
+	if (entry == NULL) {
+		return EFAULT;
+	}
+
+	us = kmalloc(sizeof(*us));
+	if (us == NULL) {
+		return ENOMEM;
+	}
+	ut = kmalloc(sizeof(*ut));
+	if (ut == NULL) {
+		kfree(us);
+		return ENOMEM;
+	}
+
+	lock_acquire(p->p_ulock);
+	if (p->p_exiting) {
+		lock_release(p->p_ulock);
+		kfree(ut);
+		kfree(us);
+		return EINTR;
+	}
+	result = as_define_threadstack(p->p_addrspace, &slot, &stack);
+	if (result) {
+		lock_release(p->p_ulock);
+		kfree(ut);
+		kfree(us);
+		return result;
+	}
+	ut->ut_tid = p->p_nexttid++;
+	ut->ut_exited = false;
+	ut->ut_status = 0;
+	ut->ut_stackslot = slot;
+	result = array_add(p->p_uthreads, ut, &index);
+	if (result) {
+		as_release_threadstack(p->p_addrspace, slot);
+		lock_release(p->p_ulock);
+		kfree(ut);
+		kfree(us);
+		return result;
+	}
+	lock_release(p->p_ulock);
+
+	us->us_entry = (vaddr_t)entry;
+	us->us_stack = stack;
+	us->us_uthread = ut;
+
+	/* We keep running, so start it elsewhere if we can. */
+	result = thread_fork_placed(curthread->t_name, p, THREAD_AWAYCPU,
+				    false, uthread_enter,
+				    us, (unsigned long)arg);
+	if (result) {
+		lock_acquire(p->p_ulock);
+		KASSERT(array_get(p->p_uthreads, index) == ut);
+		array_remove(p->p_uthreads, index);
+		as_release_threadstack(p->p_addrspace, slot);
+		lock_release(p->p_ulock);
+		kfree(ut);
+		kfree(us);
+		return result;
+	}
+
+	*retval = ut->ut_tid;
+	return 0;
+}
+
+/*
+ * End the current thread, leaving STATUS for threadjoin. The process
+ * carries on unless this was its last thread, in which case it exits
+ * as if by _exit(STATUS).
+ */
+void
+sys_threadexit(int status)
+{
+	struct proc *p = curproc;
+	struct uthread *ut = curthread->t_uthread;
+
+	if (ut != NULL) {
+		lock_acquire(p->p_ulock);
+		ut->ut_exited = true;
+		ut->ut_status = status;
+		/* We're never going back to user mode, so the stack can go. */
+		as_release_threadstack(p->p_addrspace, ut->ut_stackslot);
+		cv_broadcast(p->p_ucv, p->p_ulock);
+		lock_release(p->p_ulock);
+		curthread->t_uthread = NULL;
+	}
+
+	proc_leave(_MKWAIT_EXIT(status));
+}
+
+/*
+ * Futex operations on the word at UADDR; see <kern/futex.h>.
+ */
+int
+sys_futex(userptr_t uaddr, int op, int val, int32_t *retval)
+{
+	struct addrspace *as = curproc->p_addrspace;
+	int result;
+
+	if ((vaddr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	switch (op) {
+	    case FUTEX_WAIT:
+		result = futex_wait(as, uaddr, val);
+		if (result) {
+			return result;
+		}
+		*retval = 0;
+		return 0;
+	    case FUTEX_WAKE:
+		if (val < 0) {
+			return EINVAL;
+		}
+		*retval = futex_wake(as, uaddr, val);
+		return 0;
+	}
+	return EINVAL;
+}
+
+/*
+ * Wait for thread TID of the current process to call threadexit and
+ * collect its status. A thread can be joined only once.
+ */
+int
+sys_threadjoin(int tid, userptr_t status)
+{
+	struct proc *p = curproc;
+	struct uthread *ut;
+	unsigned index;
+	int exitstatus;
+
+	lock_acquire(p->p_ulock);
+	while (1) {
+		/* Look it up afresh each time; someone else may have joined it. */
+		ut = uthread_find(p, tid, &index);
+		if (ut == NULL) {
+			lock_release(p->p_ulock);
+			return ESRCH;
+		}
+		if (ut == curthread->t_uthread) {
+			lock_release(p->p_ulock);
+			return EINVAL;
+		}
+		if (ut->ut_exited) {
+			break;
+		}
+		if (p->p_exiting) {
+			lock_release(p->p_ulock);
+			return EINTR;
+		}
+		cv_wait(p->p_ucv, p->p_ulock);
+	}
+	array_remove(p->p_uthreads, index);
+	lock_release(p->p_ulock);
+
+	exitstatus = ut->ut_status;
+	kfree(ut);
+
+	if (status != NULL) {
+		return copyout(&exitstatus, status, sizeof(int));
+	}
+	return 0;
+}
@@ -28,7 +28,10 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
 #include <clock.h>
+#include <timeout.h>
 #include <copyinout.h>
 #include <syscall.h>
 
@@ -56,3 +59,40 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Sleep for the requested interval, rounded up to the timer
+ * resolution. Nothing can interrupt the sleep, so the remaining time
+ * (if asked for) is always zero.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec ts;
+	int result;
+
+	result = copyin(user_req, &ts, sizeof(ts));
+	if (result) {
+		return result;
+	}
+	if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	/* (only cut short when the process is exiting; see proc_exit) */
+	result = timeout_sleep_intr(timeout_ticks(ts.tv_sec, ts.tv_nsec));
+	if (result) {
+		return result;
+	}
+
+	if (user_rem != NULL) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 0;
+		result = copyout(&ts, user_rem, sizeof(ts));
+		if (result) {
+			return result;
+		}
+	}
+
+	return 0;
+}
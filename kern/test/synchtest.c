@@ -36,11 +36,13 @@
 #include <clock.h>
 #include <thread.h>
 #include <synch.h>
+#include <spinlock.h>
 #include <test.h>
 
 #define NSEMLOOPS     63
 #define NLOCKLOOPS    120
 #define NCVLOOPS      5
+#define NRWLOOPS      120
 #define NTHREADS      32
 
 static volatile unsigned long testval1;
@@ -50,11 +52,13 @@ static volatile unsigned long testval3;
 static struct semaphore *testsem = 0;
 static struct lock *testlock = 0;
 static struct cv *testcv = 0;
+static struct rwlock *testrwlock = 0;
 static struct semaphore *donesem = 0;
 #else
 static struct semaphore *testsem;
 static struct lock *testlock;
 static struct cv *testcv;
+static struct rwlock *testrwlock;
 static struct semaphore *donesem;
 #endif
 
@@ -67,6 +71,7 @@ cleanitems(void)
 	sem_destroy(testsem);
 	lock_destroy(testlock);
 	cv_destroy(testcv);
+	rwlock_destroy(testrwlock);
 	sem_destroy(donesem);
 	}
 #endif
@@ -97,6 +102,12 @@ inititems(void)
 			panic("synchtest: cv_create failed\n");
 		}
 	}
+	if (testrwlock==NULL) {
+		testrwlock = rwlock_create("testrwlock", true);
+		if (testrwlock == NULL) {
+			panic("synchtest: rwlock_create failed\n");
+		}
+	}
 	if (donesem==NULL) {
 		donesem = sem_create("donesem", 0);
 		if (donesem == NULL) {
@@ -347,3 +358,138 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Reader-writer lock test. One thread in four is a writer, which
+ * updates the test values and every other time downgrades to check
+ * them in shared mode. The rest are readers, which check the values
+ * are consistent and that no writer is in with them. The number of
+ * readers seen inside at once shows how well the lock shares.
+ */
+
+static struct spinlock rwtest_lock = SPINLOCK_INITIALIZER;
+static volatile unsigned rwtest_readers;
+static volatile unsigned rwtest_maxreaders;
+static volatile bool rwtest_writer;
+static volatile bool rwtest_failed;
+
+static
+void
+rwtestcheck(unsigned long num, const char *mode)
+{
+	if (testval2 != testval1*testval1 || testval3 != testval1%3) {
+		kprintf("thread %lu: Mismatch in %s mode\n", num, mode);
+		rwtest_failed = true;
+	}
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (num % 4 == 0) {
+			rwlock_acquire_write(testrwlock);
+			rwtest_writer = true;
+			if (rwtest_readers != 0) {
+				kprintf("thread %lu: Writer in with readers\n",
+					num);
+				rwtest_failed = true;
+			}
+			testval1 = num;
+			thread_yield();
+			testval2 = num*num;
+			testval3 = num%3;
+			rwtest_writer = false;
+			if (i % 2 == 0) {
+				rwlock_release_write(testrwlock);
+				continue;
+			}
+			rwlock_downgrade(testrwlock);
+			rwtestcheck(num, "downgraded");
+			if (testval1 != num) {
+				kprintf("thread %lu: Writer got in during "
+					"downgrade\n", num);
+				rwtest_failed = true;
+			}
+			rwlock_release_read(testrwlock);
+			continue;
+		}
+
+		rwlock_acquire_read(testrwlock);
+		spinlock_acquire(&rwtest_lock);
+		rwtest_readers++;
+		if (rwtest_readers > rwtest_maxreaders) {
+			rwtest_maxreaders = rwtest_readers;
+		}
+		spinlock_release(&rwtest_lock);
+
+		if (rwtest_writer) {
+			kprintf("thread %lu: Reader in with writer\n", num);
+			rwtest_failed = true;
+		}
+		rwtestcheck(num, "shared");
+		/* Give other readers a chance to come in too. */
+		thread_yield();
+		rwtestcheck(num, "shared");
+
+		spinlock_acquire(&rwtest_lock);
+		rwtest_readers--;
+		spinlock_release(&rwtest_lock);
+		rwlock_release_read(testrwlock);
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+int
+rwlocktest(int nargs, char **args)
+{
+	int i, result;
+	time_t secs1, secs2, secs;
+	uint32_t nsecs1, nsecs2, nsecs;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting rwlock test...\n");
+
+	testval1 = testval2 = testval3 = 0;
+	rwtest_readers = rwtest_maxreaders = 0;
+	rwtest_writer = false;
+	rwtest_failed = false;
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("synchtest", NULL, rwtestthread,
+				     NULL, i);
+		if (result) {
+			panic("rwlocktest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("Up to %u readers at once; took %llu.%09lu seconds\n",
+		rwtest_maxreaders, (unsigned long long)secs,
+		(unsigned long)nsecs);
+	if (rwtest_failed) {
+		kprintf("Test failed\n");
+	}
+	kprintf("Rwlock test done.\n");
+
+	return 0;
+}
@@ -31,6 +31,7 @@
  * Thread test code.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <thread.h>
 #include <synch.h>
@@ -93,18 +94,23 @@ quietthread(void *junk, unsigned long num)
 	V(tsem);
 }
 
+/*
+ * Run the threads, all pinned to cpu CPUNUM, or wherever the
+ * scheduler puts them if CPUNUM is THREAD_ANYCPU.
+ */
 static
 void
-runthreads(int doloud)
+runthreads(int doloud, int cpunum)
 {
 	char name[16];
 	int i, result;
 
 	for (i=0; i<NTHREADS; i++) {
 		snprintf(name, sizeof(name), "threadtest%d", i);
-		result = thread_fork(name, NULL,
-				     doloud ? loudthread : quietthread,
-				     NULL, i);
+		result = thread_fork_placed(name, NULL, cpunum,
+					    cpunum != THREAD_ANYCPU,
+					    doloud ? loudthread : quietthread,
+					    NULL, i);
 		if (result) {
 			panic("threadtest: thread_fork failed %s)\n", 
 			      strerror(result));
@@ -116,16 +122,39 @@ runthreads(int doloud)
 	}
 }
 
+/*
+ * Both tests take an optional cpu number to pin the threads to.
+ */
+static
+int
+getcpuarg(int nargs, char **args, int *cpunum)
+{
+	if (nargs < 2) {
+		*cpunum = THREAD_ANYCPU;
+		return 0;
+	}
+	*cpunum = atoi(args[1]);
+	if (nargs > 2 || *cpunum < 0 ||
+	    (unsigned)*cpunum >= thread_numcpus()) {
+		kprintf("Usage: %s [cpu]\n", args[0]);
+		return EINVAL;
+	}
+	return 0;
+}
 
 int
 threadtest(int nargs, char **args)
 {
-	(void)nargs;
-	(void)args;
+	int cpunum, result;
+
+	result = getcpuarg(nargs, args, &cpunum);
+	if (result) {
+		return result;
+	}
 
 	init_sem();
 	kprintf("Starting thread test...\n");
-	runthreads(1);
+	runthreads(1, cpunum);
 	kprintf("\nThread test done.\n");
 
 	return 0;
@@ -134,12 +163,16 @@ threadtest(int nargs, char **args)
 int
 threadtest2(int nargs, char **args)
 {
-	(void)nargs;
-	(void)args;
+	int cpunum, result;
+
+	result = getcpuarg(nargs, args, &cpunum);
+	if (result) {
+		return result;
+	}
 
 	init_sem();
 	kprintf("Starting thread test 2...\n");
-	runthreads(0);
+	runthreads(0, cpunum);
 	kprintf("\nThread test 2 done.\n");
 
 	return 0;
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Work queue test.
+ *
+ * Several threads each queue a batch of work items, some right away
+ * and some after a delay, and the test checks that every item runs
+ * exactly once.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <thread.h>
+#include <synch.h>
+#include <workqueue.h>
+#include <test.h>
+
+#define NWQTHREADS	4
+#define NWQITEMS	16
+#define NWQDELAY	3	/* ticks, for every other item */
+
+static struct work wqitems[NWQTHREADS][NWQITEMS];
+static volatile unsigned wqruns[NWQTHREADS][NWQITEMS];
+static struct semaphore *wqdone;
+
+static
+void
+wqfunc(void *arg)
+{
+	volatile unsigned *runs = arg;
+
+	(*runs)++;
+	V(wqdone);
+}
+
+static
+void
+wqthread(void *data1, unsigned long n)
+{
+	struct workqueue *wq = data1;
+	unsigned i;
+	bool ok;
+
+	for (i=0; i<NWQITEMS; i++) {
+		work_init(&wqitems[n][i], wqfunc, (void *)&wqruns[n][i]);
+		if (i % 2) {
+			ok = work_enqueue_delayed(wq, &wqitems[n][i], NWQDELAY);
+		}
+		else {
+			ok = work_enqueue(wq, &wqitems[n][i]);
+		}
+		KASSERT(ok);
+		thread_yield();
+	}
+}
+
+int
+workqueuetest(int nargs, char **args)
+{
+	struct workqueue *wq;
+	unsigned i, j;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting work queue test...\n");
+
+	wq = workqueue_create("wqtest");
+	if (wq == NULL) {
+		panic("workqueuetest: workqueue_create failed\n");
+	}
+	wqdone = sem_create("wqdone", 0);
+	if (wqdone == NULL) {
+		panic("workqueuetest: sem_create failed\n");
+	}
+
+	for (i=0; i<NWQTHREADS; i++) {
+		for (j=0; j<NWQITEMS; j++) {
+			wqruns[i][j] = 0;
+		}
+	}
+
+	for (i=0; i<NWQTHREADS; i++) {
+		result = thread_fork("wqtest", NULL, wqthread, wq, i);
+		if (result) {
+			panic("workqueuetest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	for (i=0; i<NWQTHREADS*NWQITEMS; i++) {
+		P(wqdone);
+	}
+
+	/* Everything has run, so the workers are idle; shut them down. */
+	workqueue_destroy(wq);
+	sem_destroy(wqdone);
+
+	for (i=0; i<NWQTHREADS; i++) {
+		for (j=0; j<NWQITEMS; j++) {
+			if (wqruns[i][j] != 1) {
+				panic("workqueuetest: item %u/%u ran %u times\n",
+				      i, j, wqruns[i][j]);
+			}
+		}
+	}
+
+	kprintf("Work queue test done.\n");
+	return 0;
+}
@@ -33,15 +33,17 @@
 #include <wchan.h>
 #include <clock.h>
 #include <thread.h>
+#include <mainbus.h>
+#include <timeout.h>
 #include <lamebus/ltimer.h>
 #include <current.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * This is pretty primitive. Callbacks at specific points in the
+ * future are scheduled with the timeout code (timeout.c), with a
+ * resolution of LT_GRANULARITY usec.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -53,58 +55,78 @@
  */
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
+#define IDLE_HARDCLOCKS		HZ	/* Idle cpus tick once a second. */
+#define LOADAVG_HARDCLOCKS	(5*HZ)	/* Sample load every 5 seconds. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Load average decay per sample, exp(-5/60), exp(-5/300) and
+ * exp(-5/900), in fixed point.
  */
-static struct wchan *lbolt;
-/*
- * Once every LT_GRANULARITY usec, everything on minibolt is awakenened by CPU 0
- */
-static struct wchan *minibolt;
+static const unsigned loadavg_decay[LOADAVG_NAVG] = { 1884, 2014, 2037 };
 
-/* 
- * number of minibolts per second
+/*
+ * Setup.
  */
-#define MINI_PER_SECOND (1000000/LT_GRANULARITY);
+void
+hardclock_bootstrap(void)
+{
+	timeout_bootstrap();
+}
 
 /*
- * minibolt countdown
+ * This is called once every every LT_GRANULARITY usec, on one processor,
+ * by the timer code. Sleeping threads and other timeouts are run off
+ * the timing wheel in timeout.c.
  */
-static int minicount;
+void
+timerclock(void)
+{
+	timeout_tick();
+}
 
 /*
- * Setup.
+ * Fold this cpu's current load (its running thread, if any, and its
+ * run queue) into its load averages. The run queue length is read
+ * without locking; it's only a sample.
  */
+static
 void
-hardclock_bootstrap(void)
+loadavg_sample(void)
 {
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
-	}
-	minibolt = wchan_create("minibolt");
-	if (minibolt == NULL) {
-		panic("Couldn't create minibolt\n");
+	unsigned load, i;
+
+	load = curcpu->c_runqueue.tl_count + (curcpu->c_isidle ? 0 : 1);
+	load <<= LOADAVG_FSHIFT;
+	for (i=0; i<LOADAVG_NAVG; i++) {
+		curcpu->c_loadavg[i] = (curcpu->c_loadavg[i] * loadavg_decay[i] +
+			load * (LOADAVG_FSCALE - loadavg_decay[i]))
+			>> LOADAVG_FSHIFT;
 	}
-	minicount = MINI_PER_SECOND;
-	/* we assume MINI_PER_SECOND > 0 */
-	KASSERT(minicount > 0);
 }
 
 /*
- * This is called once every every LT_GRANULARITY usec, on one processor,
- * by the timer code.
+ * Charge the current tick: to the current thread, in user mode or
+ * the kernel according to where the timer interrupted it, or to the
+ * cpu's idle time. IDLETICKS more were skipped while idle.
  */
+static
 void
-timerclock(void)
+hardclock_charge(unsigned idleticks)
 {
-	/* Broadcast on minibolt */
-	wchan_wakeall(minibolt);
-	/* Broadcast on lbolt if a second has elapsed */
-	if (--minicount <= 0) {
-	  minicount = MINI_PER_SECOND;
-	  wchan_wakeall(lbolt);
+	struct cpuusage *u;
+
+	curcpu->c_idleticks += idleticks;
+	if (curcpu->c_isidle) {
+		curcpu->c_idleticks++;
+		return;
+	}
+	curcpu->c_busyticks++;
+	u = &curthread->t_usage;
+	if (curcpu->c_intruser) {
+		u->cu_utime++;
+	}
+	else {
+		u->cu_stime++;
 	}
 }
 
@@ -115,18 +137,76 @@ timerclock(void)
 void
 hardclock(void)
 {
-	/*
-	 * Collect statistics here as desired.
-	 */
+	unsigned ticks;
+	bool migrate = false;
 
-	curcpu->c_hardclocks++;
-	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
-		schedule();
+	/* Catch up on any ticks skipped while idle. */
+	ticks = curcpu->c_tickspan;
+	curcpu->c_tickspan = 1;
+	hardclock_charge(ticks - 1);
+	while (ticks-- > 0) {
+		curcpu->c_hardclocks++;
+		if ((curcpu->c_hardclocks % LOADAVG_HARDCLOCKS) == 0) {
+			loadavg_sample();
+		}
+		if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
+			schedule();
+		}
+		if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
+			migrate = true;
+		}
 	}
-	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
+	if (migrate) {
 		thread_consider_migration();
 	}
-	thread_yield();
+	thread_timeslice();
+}
+
+/*
+ * Tickless idle.
+ *
+ * An idle cpu has nothing to time-slice, so there is no point taking
+ * a timer interrupt on it HZ times a second just to find that out.
+ * Before halting, the idle loop stretches the timer out to
+ * IDLE_HARDCLOCKS; timed sleeps don't depend on it, since they are
+ * woken by timerclock(). The cpu still wakes up then so that periodic
+ * bookkeeping in schedule() doesn't fall too far behind.
+ *
+ * When the cpu gets work again, hardclock_unidle() shortens the
+ * timer to the end of the current period, and the next hardclock()
+ * accounts for all the periods that went by.
+ *
+ * Both are called from the idle loop with interrupts off.
+ */
+void
+hardclock_idle(void)
+{
+	KASSERT(curthread->t_curspl > 0);
+
+	curcpu->c_tickspan = IDLE_HARDCLOCKS;
+	mainbus_settimer(IDLE_HARDCLOCKS);
+}
+
+void
+hardclock_unidle(void)
+{
+	unsigned span;
+
+	KASSERT(curthread->t_curspl > 0);
+
+	if (curcpu->c_tickspan > 1) {
+		/*
+		 * If the count goes past the end of the period between
+		 * reading it and setting the timer, the timer won't go
+		 * off until the count wraps, minutes later. So check
+		 * afterwards, and if it has, aim for the next period.
+		 */
+		do {
+			span = mainbus_timer_elapsed() + 1;
+			mainbus_settimer(span);
+		} while (mainbus_timer_elapsed() >= span);
+		curcpu->c_tickspan = span;
+	}
 }
 
 /*
@@ -135,10 +215,8 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-  while (num_secs > 0) {
-    wchan_lock(lbolt);
-    wchan_sleep(lbolt);
-    num_secs--;
+  if (num_secs > 0) {
+    timeout_sleep(timeout_ticks(num_secs, 0));
   }
 }
 
@@ -149,9 +227,7 @@ clocksleep(int num_secs)
 void
 clocknap(int num_ticks)
 {
-  while (num_ticks > 0) {
-    wchan_lock(minibolt);
-    wchan_sleep(minibolt);
-    num_ticks--;
+  if (num_ticks > 0) {
+    timeout_sleep(num_ticks);
   }
 }
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futex wait and wake; see futex.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <synch.h>
+#include <wchan.h>
+#include <current.h>
+#include <proc.h>
+#include <futex.h>
+
+/* Number of hash buckets; must be a power of 2. */
+#define FUTEX_NBUCKETS	64
+
+/*
+ * A thread waiting in futex_wait. Lives on the waiter's stack and is
+ * on its bucket's list until a waker takes it off.
+ */
+struct futex_waiter {
+	struct futex_waiter *fw_next;
+	struct addrspace *fw_as;
+	userptr_t fw_uaddr;
+	struct thread *fw_thread;
+	bool fw_woken;
+};
+
+struct futex_bucket {
+	struct lock *fb_lock;		/* Protects fb_waiters */
+	struct wchan *fb_wchan;		/* Waiters sleep here */
+	struct futex_waiter *fb_waiters;
+};
+
+static struct futex_bucket *futex_table;
+
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, userptr_t uaddr)
+{
+	uintptr_t h;
+
+	/* Words are aligned, so the bottom two bits are always 0. */
+	h = ((uintptr_t)uaddr >> 2) ^ ((uintptr_t)as >> 6);
+	h ^= h >> 8;
+	return &futex_table[h & (FUTEX_NBUCKETS - 1)];
+}
+
+void
+futex_bootstrap(void)
+{
+	struct futex_bucket *fb;
+	unsigned i;
+
+	futex_table = kmalloc(FUTEX_NBUCKETS * sizeof(*futex_table));
+	if (futex_table == NULL) {
+		panic("futex_bootstrap: Out of memory\n");
+	}
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		fb = &futex_table[i];
+		fb->fb_lock = lock_create("futex");
+		fb->fb_wchan = wchan_create("futex");
+		if (fb->fb_lock == NULL || fb->fb_wchan == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		fb->fb_waiters = NULL;
+	}
+}
+
+/*
+ * Take FW off FB's list and wake it. Call with the bucket lock held.
+ *
+ * The waiter may not be on the channel yet, but it holds the channel
+ * lock from before it let go of the bucket lock until it is, so
+ * wchan_wakethread, which takes that lock, always finds it there, in
+ * constant time. So a wake costs the walk of this bucket's waiter
+ * list and nothing per waiter beyond that.
+ */
+static
+void
+futex_wakewaiter(struct futex_bucket *fb, struct futex_waiter **fwp)
+{
+	struct futex_waiter *fw = *fwp;
+
+	*fwp = fw->fw_next;
+	fw->fw_woken = true;
+	wchan_wakethread(fb->fb_wchan, fw->fw_thread);
+}
+
+int
+futex_wait(struct addrspace *as, userptr_t uaddr, int val)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter fw;
+	int cur, result;
+
+	fb = futex_hash(as, uaddr);
+
+	lock_acquire(fb->fb_lock);
+	result = copyin(uaddr, &cur, sizeof(cur));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (cur != val) {
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+	/* futex_wakeall runs after p_exiting is set, so check under the lock. */
+	if (curproc->p_exiting) {
+		lock_release(fb->fb_lock);
+		return EINTR;
+	}
+
+	fw.fw_as = as;
+	fw.fw_uaddr = uaddr;
+	fw.fw_thread = curthread;
+	fw.fw_woken = false;
+	fw.fw_next = fb->fb_waiters;
+	fb->fb_waiters = &fw;
+
+	/* As in cv_wait: wakers need the bucket lock, and then the wchan. */
+	wchan_lock(fb->fb_wchan);
+	lock_release(fb->fb_lock);
+	wchan_sleep(fb->fb_wchan);
+
+	/*
+	 * Wakers take us off the list before waking us. Wait for ours
+	 * to let go of the bucket before FW goes out of scope.
+	 */
+	lock_acquire(fb->fb_lock);
+	KASSERT(fw.fw_woken);
+	lock_release(fb->fb_lock);
+
+	return 0;
+}
+
+unsigned
+futex_wake(struct addrspace *as, userptr_t uaddr, unsigned max)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter **fwp;
+	unsigned n = 0;
+
+	fb = futex_hash(as, uaddr);
+
+	lock_acquire(fb->fb_lock);
+	fwp = &fb->fb_waiters;
+	while (*fwp != NULL && n < max) {
+		if ((*fwp)->fw_as == as && (*fwp)->fw_uaddr == uaddr) {
+			futex_wakewaiter(fb, fwp);
+			n++;
+		}
+		else {
+			fwp = &(*fwp)->fw_next;
+		}
+	}
+	lock_release(fb->fb_lock);
+
+	return n;
+}
+
+void
+futex_wakeall(struct addrspace *as)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter **fwp;
+	unsigned i;
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		fb = &futex_table[i];
+		lock_acquire(fb->fb_lock);
+		fwp = &fb->fb_waiters;
+		while (*fwp != NULL) {
+			if ((*fwp)->fw_as == as) {
+				futex_wakewaiter(fb, fwp);
+			}
+			else {
+				fwp = &(*fwp)->fw_next;
+			}
+		}
+		lock_release(fb->fb_lock);
+	}
+}
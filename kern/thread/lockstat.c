@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock contention statistics. See lockstat.h.
+ *
+ * The records come from a fixed table rather than kmalloc, since
+ * kmalloc's own spinlock is one of the things being measured. For the
+ * same reason the table and the records are protected with bare
+ * machine-level test-and-set locks, at splhigh, rather than with
+ * spinlocks.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <mainbus.h>
+#include <cpu.h>
+#include <current.h>
+#include <lockstat.h>
+
+#define LOCKSTAT_MAX 256
+
+static struct lockstat lockstat_table[LOCKSTAT_MAX];
+static unsigned lockstat_count;
+static volatile spinlock_data_t lockstat_tablelock = SPINLOCK_DATA_INITIALIZER;
+
+/* Where everything goes once the table is full. */
+static struct lockstat lockstat_other = { .ls_name = "(other)" };
+
+static
+void
+lockstat_rawlock(volatile spinlock_data_t *sd)
+{
+	while (spinlock_data_get(sd) != 0 ||
+	       spinlock_data_testandset(sd) != 0) {
+		/* spin */
+	}
+}
+
+static
+void
+lockstat_rawunlock(volatile spinlock_data_t *sd)
+{
+	spinlock_data_set(sd, 0);
+}
+
+struct lockstat *
+lockstat_get(const char *name)
+{
+	struct lockstat *ls;
+	unsigned i;
+	int s;
+
+	s = splhigh();
+	lockstat_rawlock(&lockstat_tablelock);
+
+	ls = NULL;
+	for (i=0; i<lockstat_count; i++) {
+		if (!strcmp(lockstat_table[i].ls_name, name)) {
+			ls = &lockstat_table[i];
+			break;
+		}
+	}
+	if (ls == NULL && lockstat_count < LOCKSTAT_MAX) {
+		ls = &lockstat_table[lockstat_count++];
+		snprintf(ls->ls_name, sizeof(ls->ls_name), "%s", name);
+	}
+	if (ls == NULL) {
+		ls = &lockstat_other;
+	}
+
+	lockstat_rawunlock(&lockstat_tablelock);
+	splx(s);
+	return ls;
+}
+
+uint64_t
+lockstat_now(void)
+{
+	return mainbus_cycles();
+}
+
+unsigned
+lockstat_cpu(void)
+{
+	return CURCPU_EXISTS() ? curcpu->c_number : 0;
+}
+
+uint64_t
+lockstat_since(uint64_t start, unsigned startcpu)
+{
+	uint64_t now = lockstat_now();
+
+	if (lockstat_cpu() != startcpu || now < start) {
+		return 0;
+	}
+	return now - start;
+}
+
+void
+lockstat_acquired(struct lockstat *ls, bool contended, uint64_t wait)
+{
+	int s;
+
+	s = splhigh();
+	lockstat_rawlock(&ls->ls_lock);
+	ls->ls_acquires++;
+	if (contended) {
+		ls->ls_contended++;
+		ls->ls_waitcycles += wait;
+		if (wait > ls->ls_maxwait) {
+			ls->ls_maxwait = wait;
+		}
+	}
+	lockstat_rawunlock(&ls->ls_lock);
+	splx(s);
+}
+
+void
+lockstat_released(struct lockstat *ls, uint64_t hold)
+{
+	int s;
+
+	s = splhigh();
+	lockstat_rawlock(&ls->ls_lock);
+	ls->ls_holdcycles += hold;
+	lockstat_rawunlock(&ls->ls_lock);
+	splx(s);
+}
+
+void
+lockstat_print(unsigned n)
+{
+	struct lockstat *ls;
+	unsigned i, j, count, best;
+
+	count = lockstat_count;
+	for (i=0; i<count; i++) {
+		lockstat_table[i].ls_printed = false;
+	}
+
+	kprintf("%-32s %9s %9s %12s %10s %12s\n", "lock", "acquires",
+		"contended", "wait", "maxwait", "hold");
+	/* Selection by total wait; the table isn't big enough to care. */
+	for (i=0; i<n && i<count; i++) {
+		best = count;
+		for (j=0; j<count; j++) {
+			if (lockstat_table[j].ls_printed) {
+				continue;
+			}
+			if (best == count || lockstat_table[j].ls_waitcycles >
+			    lockstat_table[best].ls_waitcycles) {
+				best = j;
+			}
+		}
+		ls = &lockstat_table[best];
+		ls->ls_printed = true;
+		kprintf("%-32s %9u %9u %12llu %10llu %12llu\n", ls->ls_name,
+			ls->ls_acquires, ls->ls_contended,
+			(unsigned long long)ls->ls_waitcycles,
+			(unsigned long long)ls->ls_maxwait,
+			(unsigned long long)ls->ls_holdcycles);
+	}
+	if (lockstat_other.ls_acquires > 0) {
+		kprintf("(%u acquires of locks beyond the first %u names "
+			"not shown)\n", lockstat_other.ls_acquires,
+			LOCKSTAT_MAX);
+	}
+}
+
+void
+lockstat_reset(void)
+{
+	struct lockstat *ls;
+	unsigned i;
+	int s;
+
+	for (i=0; i<=lockstat_count; i++) {
+		ls = (i < lockstat_count) ? &lockstat_table[i] :
+			&lockstat_other;
+		s = splhigh();
+		lockstat_rawlock(&ls->ls_lock);
+		ls->ls_acquires = 0;
+		ls->ls_contended = 0;
+		ls->ls_waitcycles = 0;
+		ls->ls_maxwait = 0;
+		ls->ls_holdcycles = 0;
+		lockstat_rawunlock(&ls->ls_lock);
+		splx(s);
+	}
+}
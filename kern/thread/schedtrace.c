@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Scheduler event tracing. See schedtrace.h.
+ *
+ * Each ring counts the events ever written to it (r_head, advanced
+ * only by its own cpu) and the events ever read from it (r_tail,
+ * advanced only by the reader, under schedtrace_readlock). Event N
+ * lives in slot N % SCHEDTRACE_RINGSIZE. The writer never waits for
+ * the reader; if it laps it, the reader notices from the counts and
+ * skips what was overwritten, including anything overwritten while
+ * it was copying.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <cpu.h>
+#include <current.h>
+#include <mainbus.h>
+#include <schedtrace.h>
+
+struct schedtrace_ring {
+	volatile unsigned r_head;	/* Events written */
+	unsigned r_tail;		/* Events read */
+	struct schedtrace_event r_events[SCHEDTRACE_RINGSIZE];
+};
+
+volatile bool schedtrace_enabled;
+
+static struct schedtrace_ring *schedtrace_rings[SCHEDTRACE_MAXCPUS];
+static struct spinlock schedtrace_readlock = SPINLOCK_INITIALIZER;
+static unsigned schedtrace_nextcpu;	/* Where the next drain starts */
+
+void
+schedtrace_cpu_init(unsigned cpunum)
+{
+	struct schedtrace_ring *r;
+
+	if (cpunum >= SCHEDTRACE_MAXCPUS) {
+		/* This cpu just doesn't get traced. */
+		return;
+	}
+
+	r = kmalloc(sizeof(*r));
+	if (r == NULL) {
+		kprintf("schedtrace: no memory for cpu %u's ring\n", cpunum);
+		return;
+	}
+	r->r_head = 0;
+	r->r_tail = 0;
+	schedtrace_rings[cpunum] = r;
+}
+
+void
+schedtrace_emit(unsigned type, const void *thread, uint32_t arg, uint32_t arg2)
+{
+	struct schedtrace_ring *r;
+	struct schedtrace_event *e;
+	unsigned cpunum;
+	int spl;
+
+	spl = splhigh();
+
+	cpunum = curcpu->c_number;
+	r = cpunum < SCHEDTRACE_MAXCPUS ? schedtrace_rings[cpunum] : NULL;
+	if (r != NULL) {
+		e = &r->r_events[r->r_head % SCHEDTRACE_RINGSIZE];
+		e->ste_time = mainbus_cycles();
+		e->ste_thread = (uint32_t)(uintptr_t)thread;
+		e->ste_arg = arg;
+		e->ste_arg2 = arg2;
+		e->ste_type = type;
+		e->ste_cpu = cpunum;
+		r->r_head++;
+	}
+
+	splx(spl);
+}
+
+void
+schedtrace_start(void)
+{
+	unsigned i;
+
+	spinlock_acquire(&schedtrace_readlock);
+	for (i=0; i<SCHEDTRACE_MAXCPUS; i++) {
+		if (schedtrace_rings[i] != NULL) {
+			schedtrace_rings[i]->r_tail = schedtrace_rings[i]->r_head;
+		}
+	}
+	schedtrace_enabled = true;
+	spinlock_release(&schedtrace_readlock);
+}
+
+void
+schedtrace_stop(void)
+{
+	schedtrace_enabled = false;
+}
+
+/*
+ * Move up to MAX events from cpu CPUNUM's ring R into BUF, preceded by
+ * an STE_LOST record if any were overwritten. Returns the number of
+ * records moved.
+ */
+static
+unsigned
+schedtrace_drain_ring(unsigned cpunum, struct schedtrace_ring *r,
+		      struct schedtrace_event *buf, unsigned max)
+{
+	unsigned head, start, n, i, lost, bad;
+	struct schedtrace_event *out;
+
+	KASSERT(spinlock_do_i_hold(&schedtrace_readlock));
+
+	head = r->r_head;
+	start = r->r_tail;
+	lost = 0;
+	if (head - start > SCHEDTRACE_RINGSIZE) {
+		lost = head - start - SCHEDTRACE_RINGSIZE;
+		start = head - SCHEDTRACE_RINGSIZE;
+	}
+
+	/* Leave room for the STE_LOST record, in case we need one. */
+	if (max < 2) {
+		return 0;
+	}
+	out = buf + 1;
+	n = head - start;
+	if (n > max - 1) {
+		n = max - 1;
+	}
+	for (i=0; i<n; i++) {
+		out[i] = r->r_events[(start + i) % SCHEDTRACE_RINGSIZE];
+	}
+
+	/*
+	 * The writer may have lapped us while we copied. Anything at or
+	 * before (new head - ring size) may have been (or be being)
+	 * overwritten, so drop it.
+	 */
+	head = r->r_head;
+	bad = 0;
+	if ((int)(head + 1 - SCHEDTRACE_RINGSIZE - start) > 0) {
+		bad = head + 1 - SCHEDTRACE_RINGSIZE - start;
+		if (bad > n) {
+			bad = n;
+		}
+	}
+	r->r_tail = start + n;
+	lost += bad;
+	out += bad;
+	n -= bad;
+
+	if (lost == 0) {
+		memmove(buf, out, n * sizeof(*buf));
+		return n;
+	}
+
+	out--;
+	out->ste_time = n > 0 ? out[1].ste_time : mainbus_cycles();
+	out->ste_thread = 0;
+	out->ste_arg = lost;
+	out->ste_arg2 = 0;
+	out->ste_type = STE_LOST;
+	out->ste_cpu = cpunum;
+	memmove(buf, out, (n + 1) * sizeof(*buf));
+	return n + 1;
+}
+
+unsigned
+schedtrace_drain(struct schedtrace_event *buf, unsigned max)
+{
+	struct schedtrace_ring *r;
+	unsigned i, cpunum, got;
+
+	got = 0;
+	spinlock_acquire(&schedtrace_readlock);
+	for (i=0; i<SCHEDTRACE_MAXCPUS && got < max; i++) {
+		cpunum = (schedtrace_nextcpu + i) % SCHEDTRACE_MAXCPUS;
+		r = schedtrace_rings[cpunum];
+		if (r != NULL) {
+			got += schedtrace_drain_ring(cpunum, r, buf + got,
+						     max - got);
+		}
+	}
+	/* Start with a different cpu next time, so none gets starved. */
+	schedtrace_nextcpu = (schedtrace_nextcpu + 1) % SCHEDTRACE_MAXCPUS;
+	spinlock_release(&schedtrace_readlock);
+
+	return got;
+}
+
+static
+const char *
+schedtrace_typename(unsigned type)
+{
+	switch (type) {
+	    case STE_SWITCH: return "switch";
+	    case STE_READY: return "ready";
+	    case STE_SLEEP: return "sleep";
+	    case STE_WAKE: return "wake";
+	    case STE_MIGRATE: return "migrate";
+	    case STE_IPI: return "ipi";
+	    case STE_LOST: return "lost";
+	    case STE_MISS: return "miss";
+	}
+	return "?";
+}
+
+void
+schedtrace_dump(void)
+{
+	static struct schedtrace_event buf[64];
+	unsigned i, n;
+
+	while ((n = schedtrace_drain(buf, 64)) > 0) {
+		for (i=0; i<n; i++) {
+			kprintf("%llu cpu%u %-7s %08x %08x %x\n",
+				(unsigned long long)buf[i].ste_time,
+				buf[i].ste_cpu,
+				schedtrace_typename(buf[i].ste_type),
+				buf[i].ste_thread,
+				buf[i].ste_arg, buf[i].ste_arg2);
+		}
+	}
+}
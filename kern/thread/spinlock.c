@@ -36,21 +36,85 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <current.h>	/* for curcpu */
+#include <lockstat.h>
 
 /*
  * Spinlocks.
  */
 
+/*
+ * Backoff. Spinning flat out on a contended lock keeps its cache line
+ * bouncing between cpus, which slows down the holder as well as the
+ * other waiters. So waiters pause between attempts: a test-and-set
+ * lock doubles its pause after each failure, from SPINLOCK_BACKOFF_MIN
+ * up to SPINLOCK_BACKOFF_MAX; a ticket lock pauses in proportion to
+ * the number of cpus ahead of it in line.
+ */
+#define SPINLOCK_BACKOFF_MIN	4
+#define SPINLOCK_BACKOFF_MAX	1024
+
+static
+void
+spinlock_delay(unsigned n)
+{
+	volatile unsigned i;
+
+	for (i=0; i<n; i++) {
+		/* nothing */
+	}
+}
 
 /*
  * Initialize spinlock.
  */
+#if OPT_LOCKSTAT
+void
+spinlock_init_at(struct spinlock *lk, const char *file, int line)
+#else
 void
 spinlock_init(struct spinlock *lk)
+#endif
 {
+#if OPT_TICKETLOCK
+	spinlock_data_set(&lk->lk_next, 0);
+	spinlock_data_set(&lk->lk_serving, 0);
+#else
 	spinlock_data_set(&lk->lk_lock, 0);
+#endif
 	lk->lk_holder = NULL;
+#if OPT_LOCKSTAT
+	lk->lk_file = file;
+	lk->lk_line = line;
+	lk->lk_stat = NULL;
+	lk->lk_stamp = 0;
+#endif
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Count an acquisition that started at START. The statistics record
+ * is looked up the first time, by the spinlock's file and line.
+ */
+static
+void
+spinlock_stat_acquired(struct spinlock *lk, bool contended, uint64_t start)
+{
+	char name[LOCKSTAT_NAMELEN];
+	const char *file;
+
+	if (lk->lk_stat == NULL) {
+		file = lk->lk_file != NULL ? lk->lk_file : "(unknown)";
+		/* Drop the ../../ that the build puts on */
+		while (file[0] == '.' && file[1] == '.' && file[2] == '/') {
+			file += 3;
+		}
+		snprintf(name, sizeof(name), "%s:%d", file, lk->lk_line);
+		lk->lk_stat = lockstat_get(name);
+	}
+	lk->lk_stamp = lockstat_now();
+	lockstat_acquired(lk->lk_stat, contended, lk->lk_stamp - start);
 }
+#endif
 
 /*
  * Clean up spinlock.
@@ -59,18 +123,23 @@ void
 spinlock_cleanup(struct spinlock *lk)
 {
 	KASSERT(lk->lk_holder == NULL);
+#if OPT_TICKETLOCK
+	KASSERT(spinlock_data_get(&lk->lk_next) ==
+		spinlock_data_get(&lk->lk_serving));
+#else
 	KASSERT(spinlock_data_get(&lk->lk_lock) == 0);
+#endif
 }
 
 /*
- * Get the lock.
- *
- * First disable interrupts (otherwise, if we get a timer interrupt we
- * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * Common code for acquire and tryacquire: disable interrupts
+ * (otherwise, if we get a timer interrupt we might come back to this
+ * lock and deadlock) and check we don't already hold the lock.
+ * Returns the current cpu, or NULL this early in boot.
  */
-void
-spinlock_acquire(struct spinlock *lk)
+static
+struct cpu *
+spinlock_enter(struct spinlock *lk)
 {
 	struct cpu *mycpu;
 
@@ -86,7 +155,45 @@ spinlock_acquire(struct spinlock *lk)
 	else {
 		mycpu = NULL;
 	}
+	return mycpu;
+}
 
+/*
+ * Get the lock.
+ *
+ * First disable interrupts, then use a machine-level atomic operation
+ * to wait for the lock to be free.
+ */
+void
+spinlock_acquire(struct spinlock *lk)
+{
+	struct cpu *mycpu;
+#if OPT_TICKETLOCK
+	spinlock_data_t ticket, serving;
+#else
+	unsigned backoff;
+#endif
+#if OPT_LOCKSTAT
+	uint64_t start = lockstat_now();
+	bool contended = false;
+#endif
+
+	mycpu = spinlock_enter(lk);
+
+#if OPT_TICKETLOCK
+	/*
+	 * Take a ticket and wait for it to come up. Only the holder
+	 * ever writes lk_serving, so waiting is just reading.
+	 */
+	ticket = spinlock_data_fetchadd(&lk->lk_next, 1);
+	while ((serving = spinlock_data_get(&lk->lk_serving)) != ticket) {
+#if OPT_LOCKSTAT
+		contended = true;
+#endif
+		spinlock_delay((ticket - serving) * SPINLOCK_BACKOFF_MIN);
+	}
+#else
+	backoff = SPINLOCK_BACKOFF_MIN;
 	while (1) {
 		/*
 		 * Do test-test-and-set, that is, read first before
@@ -99,15 +206,66 @@ spinlock_acquire(struct spinlock *lk)
 		 * we don't.
 		 */
 		if (spinlock_data_get(&lk->lk_lock) != 0) {
+#if OPT_LOCKSTAT
+			contended = true;
+#endif
 			continue;
 		}
 		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
+#if OPT_LOCKSTAT
+			contended = true;
+#endif
+			/* Lost a race for it; back off. */
+			spinlock_delay(backoff);
+			if (backoff < SPINLOCK_BACKOFF_MAX) {
+				backoff *= 2;
+			}
 			continue;
 		}
 		break;
 	}
+#endif
+
+	lk->lk_holder = mycpu;
+#if OPT_LOCKSTAT
+	spinlock_stat_acquired(lk, contended, start);
+#endif
+}
+
+/*
+ * Try to get the lock, but don't spin if it's held.
+ */
+bool
+spinlock_tryacquire(struct spinlock *lk)
+{
+	struct cpu *mycpu;
+#if OPT_TICKETLOCK
+	spinlock_data_t serving;
+#endif
+
+	mycpu = spinlock_enter(lk);
+
+#if OPT_TICKETLOCK
+	/* Take a ticket only if it would come up immediately. */
+	serving = spinlock_data_get(&lk->lk_serving);
+	if (spinlock_data_compareandswap(&lk->lk_next, serving, serving + 1)
+	    != serving) {
+		spllower(IPL_HIGH, IPL_NONE);
+		return false;
+	}
+#else
+	if (spinlock_data_get(&lk->lk_lock) != 0 ||
+	    spinlock_data_testandset(&lk->lk_lock) != 0) {
+		spllower(IPL_HIGH, IPL_NONE);
+		return false;
+	}
+#endif
 
 	lk->lk_holder = mycpu;
+#if OPT_LOCKSTAT
+	spinlock_stat_acquired(lk, false, lockstat_now());
+#endif
+	return true;
 }
 
 /*
@@ -121,8 +279,16 @@ spinlock_release(struct spinlock *lk)
 		KASSERT(lk->lk_holder == curcpu->c_self);
 	}
 
+#if OPT_LOCKSTAT
+	lockstat_released(lk->lk_stat, lockstat_now() - lk->lk_stamp);
+#endif
 	lk->lk_holder = NULL;
+#if OPT_TICKETLOCK
+	spinlock_data_set(&lk->lk_serving,
+			  spinlock_data_get(&lk->lk_serving) + 1);
+#else
 	spinlock_data_set(&lk->lk_lock, 0);
+#endif
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
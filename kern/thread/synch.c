@@ -39,6 +39,7 @@
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -71,6 +72,9 @@ sem_create(const char *name, int initial_count)
 
 	spinlock_init(&sem->sem_lock);
         sem->sem_count = initial_count;
+#if OPT_LOCKSTAT
+	sem->sem_stat = lockstat_get(name);
+#endif
 
         return sem;
 }
@@ -90,6 +94,12 @@ sem_destroy(struct semaphore *sem)
 void 
 P(struct semaphore *sem)
 {
+#if OPT_LOCKSTAT
+	uint64_t start = lockstat_now();
+	unsigned startcpu = lockstat_cpu();
+	bool contended;
+#endif
+
         KASSERT(sem != NULL);
 
         /*
@@ -101,6 +111,9 @@ P(struct semaphore *sem)
         KASSERT(curthread->t_in_interrupt == false);
 
 	spinlock_acquire(&sem->sem_lock);
+#if OPT_LOCKSTAT
+	contended = sem->sem_count == 0;
+#endif
         while (sem->sem_count == 0) {
 		/*
 		 * Bridge to the wchan lock, so if someone else comes
@@ -126,6 +139,10 @@ P(struct semaphore *sem)
         }
         KASSERT(sem->sem_count > 0);
         sem->sem_count--;
+#if OPT_LOCKSTAT
+	lockstat_acquired(sem->sem_stat, contended,
+			  lockstat_since(start, startcpu));
+#endif
 	spinlock_release(&sem->sem_lock);
 }
 
@@ -149,6 +166,85 @@ V(struct semaphore *sem)
 //
 ////////////////////////////////////////////////////////////
 
+/*
+ * Priority donation.
+ *
+ * A thread that blocks in lock_acquire puts itself on the lock's
+ * lk_donors list and lends its effective priority to the owner. If
+ * the owner is itself blocked on another lock, the donation is passed
+ * along to that lock's owner, and so on up the chain (to a bounded
+ * depth, in case of deadlock). When a lock is released, the former
+ * owner's donation is recomputed from the waiters on the locks it
+ * still holds.
+ *
+ * All of the donation state (t_donated, t_waitlock, t_nextdonor,
+ * lk_donors, and lk_owner while anyone is waiting) is protected by
+ * donation_lock. Since that is only taken when a lock is contended
+ * or its holder has been donated to, uncontended locks don't pay
+ * for it.
+ *
+ * Lock ordering: lk_lock, then donation_lock, then run queue locks.
+ */
+static struct spinlock donation_lock = SPINLOCK_INITIALIZER;
+
+#define DONATION_MAXDEPTH 8
+
+/* How long lock_acquire spins on a lock whose owner is running. */
+#define LOCK_SPIN_ROUNDS 16
+#define LOCK_SPIN_POLLS 64
+
+/*
+ * Lend curthread's priority to the owner of LOCK, and transitively on
+ * from there.
+ */
+static
+void
+lock_donate(struct lock *lock)
+{
+	struct thread *owner;
+	int prio, depth;
+
+	KASSERT(spinlock_do_i_hold(&donation_lock));
+
+	prio = thread_priority(curthread);
+	for (depth = 0; lock != NULL && depth < DONATION_MAXDEPTH; depth++) {
+		owner = lock->lk_owner;
+		if (owner == NULL || thread_priority(owner) <= prio) {
+			break;
+		}
+		owner->t_donated = prio;
+		thread_reprioritize(owner);
+		lock = owner->t_waitlock;
+	}
+}
+
+/*
+ * Compute the best priority lent to thread T by the waiters on the
+ * locks it holds.
+ */
+static
+int
+lock_donation(struct thread *t)
+{
+	struct lock *held;
+	struct thread *donor;
+	int best, prio;
+
+	KASSERT(spinlock_do_i_hold(&donation_lock));
+
+	best = MLFQ_NLEVELS;
+	for (held = t->t_heldlocks; held != NULL; held = held->lk_nextheld) {
+		for (donor = held->lk_donors; donor != NULL;
+		     donor = donor->t_nextdonor) {
+			prio = thread_priority(donor);
+			if (prio < best) {
+				best = prio;
+			}
+		}
+	}
+	return best;
+}
+
 struct lock *
 lock_create(const char *name)
 {
@@ -174,6 +270,13 @@ lock_create(const char *name)
 	spinlock_init(&lock->lk_lock);
 	lock->lk_held = false;
 	lock->lk_owner = NULL;
+	lock->lk_waiters = 0;
+	lock->lk_donors = NULL;
+	lock->lk_nextheld = NULL;
+#if OPT_LOCKSTAT
+	lock->lk_stat = lockstat_get(name);
+	lock->lk_stamp = 0;
+#endif
        
     return lock;
 }
@@ -182,6 +285,8 @@ void
 lock_destroy(struct lock *lock)
 {
     KASSERT(lock != NULL);
+	KASSERT(lock->lk_donors == NULL);
+	KASSERT(lock->lk_waiters == 0);
 
     spinlock_cleanup(&lock->lk_lock);
 	wchan_destroy(lock->lk_wchan);
@@ -190,35 +295,155 @@ lock_destroy(struct lock *lock)
     kfree(lock);
 }
 
+/*
+ * Adaptive spinning.
+ *
+ * If a lock's owner is running on another cpu it is likely to let go
+ * soon, sooner than it would take us to sleep and be woken again. So
+ * poll the lock for a while first, but only for as long as the owner
+ * stays on its cpu; if it blocks or is preempted, we may as well
+ * sleep. The polling is done without lk_lock so as not to slow down
+ * the owner's release.
+ *
+ * Called with lk_lock held; returns with it held, and the lock either
+ * free or not worth waiting for any longer.
+ */
+static
+void
+lock_spin(struct lock *lock)
+{
+	unsigned round, poll;
+
+	KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+
+	for (round = 0; round < LOCK_SPIN_ROUNDS; round++) {
+		if (!lock->lk_held || lock->lk_owner->t_state != S_RUN) {
+			return;
+		}
+		spinlock_release(&lock->lk_lock);
+		for (poll = 0; poll < LOCK_SPIN_POLLS && lock->lk_held; poll++) {
+			/* nothing */
+		}
+		spinlock_acquire(&lock->lk_lock);
+	}
+}
+
 void
 lock_acquire(struct lock *lock)
 {
+	struct thread **donorp;
+#if OPT_LOCKSTAT
+	uint64_t start = lockstat_now();
+	unsigned startcpu = lockstat_cpu();
+	bool contended;
+#endif
+
 	KASSERT(!lock_do_i_hold(lock));
 	KASSERT(lock != NULL);
 
 	spinlock_acquire(&lock->lk_lock);
-	//when the lock is not acquired, keep checking
-	while(lock->lk_held == true){
-		wchan_lock(lock->lk_wchan);
-		spinlock_release(&lock->lk_lock);
-		wchan_sleep(lock->lk_wchan);
-		spinlock_acquire(&lock->lk_lock);
+#if OPT_LOCKSTAT
+	contended = lock->lk_held;
+#endif
+	if (lock->lk_held) {
+		lock_spin(lock);
+	}
+	if (lock->lk_held) {
+		/* Join the waiters, so releases can see our priority. */
+		spinlock_acquire(&donation_lock);
+		curthread->t_waitlock = lock;
+		curthread->t_nextdonor = lock->lk_donors;
+		lock->lk_donors = curthread;
+		spinlock_release(&donation_lock);
+
+		//when the lock is not acquired, keep checking
+		while (lock->lk_held) {
+			/* The owner may be different each time around. */
+			spinlock_acquire(&donation_lock);
+			lock_donate(lock);
+			spinlock_release(&donation_lock);
+
+			wchan_lock(lock->lk_wchan);
+			lock->lk_waiters++;
+			spinlock_release(&lock->lk_lock);
+			wchan_sleep(lock->lk_wchan);
+			spinlock_acquire(&lock->lk_lock);
+		}
+
+		spinlock_acquire(&donation_lock);
+		for (donorp = &lock->lk_donors; *donorp != curthread;
+		     donorp = &(*donorp)->t_nextdonor) {
+			KASSERT(*donorp != NULL);
+		}
+		*donorp = curthread->t_nextdonor;
+		curthread->t_nextdonor = NULL;
+		curthread->t_waitlock = NULL;
+		lock->lk_held = true;
+		lock->lk_owner = curthread;
+		lock->lk_nextheld = curthread->t_heldlocks;
+		curthread->t_heldlocks = lock;
+		/*
+		 * Whoever is still waiting now lends to us. They are
+		 * asleep and won't donate again, so this has to see
+		 * the lock on t_heldlocks.
+		 */
+		curthread->t_donated = lock_donation(curthread);
+		spinlock_release(&donation_lock);
 	}
-	lock->lk_held = true;
-	lock->lk_owner = curthread;
+	else {
+		lock->lk_held = true;
+		lock->lk_owner = curthread;
+		lock->lk_nextheld = curthread->t_heldlocks;
+		curthread->t_heldlocks = lock;
+	}
+#if OPT_LOCKSTAT
+	lockstat_acquired(lock->lk_stat, contended,
+			  lockstat_since(start, startcpu));
+	lock->lk_stamp = lockstat_now();
+	lock->lk_stampcpu = lockstat_cpu();
+#endif
 	spinlock_release(&lock->lk_lock);
 }
 
 void
 lock_release(struct lock *lock)
 {
+	struct lock **heldp;
+
 	KASSERT(lock_do_i_hold(lock));
 	KASSERT(lock->lk_owner == curthread);
 
 	spinlock_acquire(&lock->lk_lock);
+#if OPT_LOCKSTAT
+	lockstat_released(lock->lk_stat,
+			  lockstat_since(lock->lk_stamp, lock->lk_stampcpu));
+#endif
+
+	for (heldp = &curthread->t_heldlocks; *heldp != lock;
+	     heldp = &(*heldp)->lk_nextheld) {
+		KASSERT(*heldp != NULL);
+	}
+	*heldp = lock->lk_nextheld;
+	lock->lk_nextheld = NULL;
+
+	if (lock->lk_donors != NULL || curthread->t_donated < MLFQ_NLEVELS) {
+		/* Give back what was lent to us through this lock. */
+		spinlock_acquire(&donation_lock);
+		lock->lk_owner = NULL;
+		curthread->t_donated = lock_donation(curthread);
+		spinlock_release(&donation_lock);
+	}
+	else {
+		lock->lk_owner = NULL;
+	}
+
 	lock->lk_held = false;
-	wchan_wakeone(lock->lk_wchan);
-	lock->lk_owner = NULL;
+	if (lock->lk_waiters > 0) {
+		/* (the count is exact: sleepers add themselves under lk_lock) */
+		lock->lk_waiters--;
+		/* the most urgent waiter, not the longest waiting */
+		wchan_wakebest(lock->lk_wchan);
+	}
 	spinlock_release(&lock->lk_lock);
 }
 
@@ -303,3 +528,154 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 		wchan_wakeall(cv->cv_wchan);
 	}
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name, bool writerpref)
+{
+	struct rwlock *rw;
+
+	rw = kmalloc(sizeof(struct rwlock));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rw_name = kstrdup(name);
+	if (rw->rw_name == NULL) {
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_readwchan = wchan_create(rw->rw_name);
+	if (rw->rw_readwchan == NULL) {
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_writewchan = wchan_create(rw->rw_name);
+	if (rw->rw_writewchan == NULL) {
+		wchan_destroy(rw->rw_readwchan);
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rw_lock);
+	rw->rw_readers = 0;
+	rw->rw_writerswaiting = 0;
+	rw->rw_writer = NULL;
+	rw->rw_writerpref = writerpref;
+
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_writer == NULL);
+	KASSERT(rw->rw_writerswaiting == 0);
+
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_writewchan);
+	wchan_destroy(rw->rw_readwchan);
+	kfree(rw->rw_name);
+	kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	while (rw->rw_writer != NULL ||
+	       (rw->rw_writerpref && rw->rw_writerswaiting > 0)) {
+		wchan_lock(rw->rw_readwchan);
+		spinlock_release(&rw->rw_lock);
+		wchan_sleep(rw->rw_readwchan);
+		spinlock_acquire(&rw->rw_lock);
+	}
+	rw->rw_readers++;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_writer == NULL);
+	rw->rw_readers--;
+	if (rw->rw_readers == 0 && rw->rw_writerswaiting > 0) {
+		wchan_wakeone(rw->rw_writewchan);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(rw->rw_writer != curthread);
+
+	spinlock_acquire(&rw->rw_lock);
+	rw->rw_writerswaiting++;
+	while (rw->rw_writer != NULL || rw->rw_readers > 0) {
+		wchan_lock(rw->rw_writewchan);
+		spinlock_release(&rw->rw_lock);
+		wchan_sleep(rw->rw_writewchan);
+		spinlock_acquire(&rw->rw_lock);
+	}
+	rw->rw_writerswaiting--;
+	rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer == curthread);
+	rw->rw_writer = NULL;
+	if (rw->rw_writerswaiting > 0) {
+		wchan_wakeone(rw->rw_writewchan);
+	}
+	if (!rw->rw_writerpref || rw->rw_writerswaiting == 0) {
+		wchan_wakeall(rw->rw_readwchan);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_downgrade(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer == curthread);
+	rw->rw_writer = NULL;
+	rw->rw_readers++;
+	/* Other readers may come in with us, subject to writer preference. */
+	if (!rw->rw_writerpref || rw->rw_writerswaiting == 0) {
+		wchan_wakeall(rw->rw_readwchan);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	return rw->rw_writer == curthread;
+}
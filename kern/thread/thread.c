@@ -49,7 +49,11 @@
 #include <synch.h>
 #include <addrspace.h>
 #include <mainbus.h>
+#include <clock.h>
+#include <timeout.h>
+#include <lamebus/ltimer.h>
 #include <vnode.h>
+#include <schedtrace.h>
 
 #include "opt-synchprobs.h"
 
@@ -57,6 +61,48 @@
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/*
+ * Scheduler tuning. A thread at level N of the feedback queue gets a
+ * quantum of mlfq_quantum[N] hardclocks before it is demoted to level
+ * N+1. Every MLFQ_BOOST_HARDCLOCKS all threads go back to level 0 so
+ * that demoted threads cannot starve.
+ */
+static const unsigned mlfq_quantum[MLFQ_NLEVELS] = { 1, 2, 4 };
+#define MLFQ_BOOST_HARDCLOCKS	100
+
+/*
+ * The boosts are timed by the global timer (see timeout.h), not by
+ * each cpu's hardclock count: those drift apart once idle cpus skip
+ * ticks, and every cpu has to agree which boost period it's in. The
+ * epoch is the number of that period.
+ */
+#define MLFQ_BOOST_TICKS \
+	(MLFQ_BOOST_HARDCLOCKS * (1000000 / LT_GRANULARITY) / HZ)
+
+static
+unsigned
+mlfq_epoch(void)
+{
+	COMPILE_ASSERT(MLFQ_BOOST_TICKS > 0);
+	return timeout_now() / MLFQ_BOOST_TICKS;
+}
+
+/*
+ * Most of a cpu that EDF threads may reserve, in thousandths; the
+ * rest is kept for best-effort threads. See thread_edf_set().
+ */
+#define EDF_MAXUTIL	900
+
+/* Number of dead threads each cpu keeps around for thread_fork to reuse. */
+#define THREAD_CACHE_MAX 8
+
+/* Number of other cpus an idle cpu tries to steal from before halting. */
+#define STEAL_ATTEMPTS 2
+
+/* Migration cost model; see thread_consider_migration(). */
+unsigned thread_migrate_coldticks = 2;
+unsigned thread_migrate_hysteresis = 1;
+
 /* Wait channel. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -111,6 +157,58 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Initialize the fields of a new or recycled thread, other than its
+ * name and stack.
+ */
+static
+void
+thread_init(struct thread *thread)
+{
+	thread->t_wchan_name = "NEW";
+	thread->t_wchan = NULL;
+	thread->t_state = S_READY;
+
+	/* Thread subsystem fields */
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_pinned = false;
+	thread->t_wakenext = NULL;
+	thread->t_uthread = NULL;
+	thread->t_sleepto = NULL;
+	thread->t_nosleep = false;
+	thread->t_proc = NULL;
+	thread->t_lastcpu = NULL;
+	thread->t_lastrun = 0;
+
+	/* Scheduler fields */
+	thread_setlevel(thread, 0);
+	thread->t_epoch = mlfq_epoch();
+	thread->t_donated = MLFQ_NLEVELS;
+	thread->t_waitlock = NULL;
+	thread->t_heldlocks = NULL;
+	thread->t_nextdonor = NULL;
+	thread->t_edf_period = 0;
+	thread->t_edf_budget = 0;
+	thread->t_edf_used = 0;
+	thread->t_edf_deadline = 0;
+	thread->t_edf_done = false;
+	thread->t_edf_misses = 0;
+	thread->t_pass = 0;
+
+	/* Accounting */
+	bzero(&thread->t_usage, sizeof(thread->t_usage));
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+
+	/* If you add to struct thread, be sure to initialize here */
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -133,23 +231,8 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_wchan_name = "NEW";
-	thread->t_state = S_READY;
-
-	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
 	thread->t_stack = NULL;
-	thread->t_context = NULL;
-	thread->t_cpu = NULL;
-	thread->t_proc = NULL;
-
-	/* Interrupt state fields */
-	thread->t_in_interrupt = false;
-	thread->t_curspl = IPL_HIGH;
-	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
-
-	/* If you add to struct thread, be sure to initialize here */
+	thread_init(thread);
 
 	return thread;
 }
@@ -168,6 +251,7 @@ cpu_create(unsigned hardware_number)
 	struct cpu *c;
 	int result;
 	char namebuf[16];
+	unsigned i;
 
 	c = kmalloc(sizeof(*c));
 	if (c == NULL) {
@@ -179,11 +263,26 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadcache);
 	c->c_hardclocks = 0;
+	c->c_tickspan = 1;
+	c->c_intruser = false;
+	c->c_busyticks = 0;
+	c->c_idleticks = 0;
+	for (i=0; i<LOADAVG_NAVG; i++) {
+		c->c_loadavg[i] = 0;
+	}
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
+	c->c_migrated_in = 0;
+	c->c_migrated_out = 0;
+	c->c_edf_util = 0;
+	c->c_edf_misses = 0;
+	c->c_vtime = 0;
+	c->c_boostepoch = 0;
+	spinlock_data_set(&c->c_wakeups, 0);
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
@@ -193,6 +292,7 @@ cpu_create(unsigned hardware_number)
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+	schedtrace_cpu_init(c->c_number);
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
@@ -262,6 +362,72 @@ thread_destroy(struct thread *thread)
 	kfree(thread);
 }
 
+/*
+ * Get a thread, stack and all, from the current cpu's cache of dead
+ * ones, and set it up as if by thread_create. The old name buffer is
+ * kept if the new name fits in it. Returns NULL if the cache is empty
+ * (or if the name can't be allocated).
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+	char *newname;
+	int spl;
+
+	DEBUGASSERT(name != NULL);
+
+	/* The cache is per-cpu; don't get preempted while using it. */
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	splx(spl);
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	if (strlen(name) <= strlen(thread->t_name)) {
+		strcpy(thread->t_name, name);
+	}
+	else {
+		newname = kstrdup(name);
+		if (newname == NULL) {
+			thread_destroy(thread);
+			return NULL;
+		}
+		kfree(thread->t_name);
+		thread->t_name = newname;
+	}
+	thread_init(thread);
+
+	return thread;
+}
+
+/*
+ * Put a dead thread in the current cpu's cache, if it has a stack we
+ * can reuse and there's room; otherwise, destroy it. Called from
+ * exorcise(), at splhigh.
+ */
+static
+void
+thread_cache_put(struct thread *thread)
+{
+	KASSERT(curthread->t_curspl > 0);
+	KASSERT(thread->t_proc == NULL);
+
+	if (thread->t_stack == NULL ||
+	    curcpu->c_threadcache.tl_count >= THREAD_CACHE_MAX) {
+		thread_destroy(thread);
+		return;
+	}
+
+	/* The guard band must still be intact, or we'd reuse a bad stack. */
+	thread_checkstack(thread);
+	thread_machdep_cleanup(&thread->t_machdep);
+	thread->t_wchan_name = "CACHED";
+	threadlist_addhead(&curcpu->c_threadcache, thread);
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
  * need to have thread_destroy called on them.)
@@ -277,7 +443,7 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		thread_cache_put(z);
 	}
 }
 
@@ -426,21 +592,307 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Is T an EDF thread with budget left in its current period? EDF
+ * threads that have used up their budget are scheduled as best-effort
+ * threads until their next period starts.
+ */
+static
+bool
+thread_edf_active(struct thread *t)
+{
+	return t->t_edf_period != 0 && t->t_edf_used < t->t_edf_budget;
+}
+
+/*
+ * Does A outrank B? Active EDF threads go first, earliest deadline
+ * first; then everything else by priority. This is what decides
+ * preemption.
+ */
+static
+bool
+thread_outranks(struct thread *a, struct thread *b)
+{
+	bool aedf, bedf;
+
+	aedf = thread_edf_active(a);
+	bedf = thread_edf_active(b);
+	if (aedf != bedf) {
+		return aedf;
+	}
+	if (aedf) {
+		return (int)(a->t_edf_deadline - b->t_edf_deadline) < 0;
+	}
+	return thread_priority(a) < thread_priority(b);
+}
+
+/*
+ * Should A run ahead of B? If neither outranks the other, the one
+ * whose process is further behind on its fair share goes first.
+ */
+static
+bool
+thread_runs_before(struct thread *a, struct thread *b)
+{
+	if (thread_outranks(a, b)) {
+		return true;
+	}
+	if (thread_outranks(b, a)) {
+		return false;
+	}
+	return (int)(a->t_pass - b->t_pass) < 0;
+}
+
+/*
+ * Fair share.
+ *
+ * Best-effort threads at the same priority level are stride
+ * scheduled by process: each process has a number of tickets, and
+ * every tick any of its threads runs advances the process's pass by
+ * STRIDE1 / tickets. Threads are queued in order of their process's
+ * pass, so the process furthest behind goes next, however many
+ * threads it has, and threads of one process take turns.
+ *
+ * Each cpu has a virtual time, the pass of the last thread it picked.
+ * A process whose pass has fallen behind that (because it slept, or
+ * is new) is brought up to it, so it can't bank credit to crowd
+ * others out with later.
+ *
+ * Return the key to queue T on cpu C with.
+ */
+static
+unsigned
+thread_share_key(struct thread *t, struct cpu *c)
+{
+	unsigned pass;
+
+	if (t->t_proc == NULL) {
+		return c->c_vtime;
+	}
+	/* Read without p_lock; it's only a sample. */
+	pass = t->t_proc->p_pass;
+	if ((int)(pass - c->c_vtime) < 0) {
+		pass = c->c_vtime;
+	}
+	return pass;
+}
+
+/*
+ * Charge a tick to the current thread's process.
+ */
+static
+void
+thread_share_charge(struct thread *t)
+{
+	struct proc *p = t->t_proc;
+
+	if (p == NULL) {
+		return;
+	}
+	spinlock_acquire(&p->p_lock);
+	if ((int)(p->p_pass - curcpu->c_vtime) < 0) {
+		p->p_pass = curcpu->c_vtime;
+	}
+	p->p_pass += p->p_stride;
+	spinlock_release(&p->p_lock);
+}
+
+/*
+ * If an EDF thread's deadline has passed, start its next period: new
+ * deadline, full budget. If it hadn't said it was done with the
+ * period that ended (see thread_edf_wait), count a miss. Periods it
+ * slept all the way through are skipped and not counted. Call with
+ * the run queue of the thread's cpu locked.
+ */
+static
+void
+thread_edf_refresh(struct thread *t)
+{
+	struct cpu *c = t->t_cpu;
+	unsigned late;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	if (t->t_edf_period == 0) {
+		return;
+	}
+	late = c->c_hardclocks - t->t_edf_deadline;
+	if ((int)late < 0) {
+		return;
+	}
+	if (!t->t_edf_done) {
+		SCHEDTRACE(STE_MISS, t, late, 0);
+		t->t_edf_misses++;
+		c->c_edf_misses++;
+	}
+	t->t_edf_deadline += (late / t->t_edf_period + 1) * t->t_edf_period;
+	t->t_edf_used = 0;
+	t->t_edf_done = false;
+}
+
+/*
+ * Put a thread on a cpu's run queue.
+ *
+ * The run queue is kept sorted (see thread_runs_before): the thread
+ * goes behind every thread that runs at the same time or before it,
+ * so among equals the queue is round-robin. The run queue must be
+ * locked.
+ */
+static
+void
+thread_enqueue(struct cpu *c, struct thread *t)
+{
+	struct threadlistnode *tln;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	thread_edf_refresh(t);
+	t->t_pass = thread_share_key(t, c);
+
+	for (tln = c->c_runqueue.tl_tail.tln_prev;
+	     tln->tln_prev != NULL;
+	     tln = tln->tln_prev) {
+		if (!thread_runs_before(t, tln->tln_self)) {
+			threadlist_insertafter(&c->c_runqueue,
+					       tln->tln_self, t);
+			return;
+		}
+	}
+	threadlist_addhead(&c->c_runqueue, t);
+}
+
+/*
+ * Wake up an idle cpu, if there is one, so it can come and steal work
+ * from BUSY's run queue (see thread_steal). Only worth it when more
+ * threads are waiting there than BUSY will run next: waking an idle
+ * cpu costs it its tickless sleep (see hardclock_idle).
+ *
+ * The idle flags are read without locking, so an IPI can be spurious
+ * or a chance missed. A missed chance can leave the work queued until
+ * the idle cpu's next timer tick, up to a second away; but a cpu
+ * about to idle looks for work to steal after setting c_isidle, so it
+ * can only miss work queued in that short window.
+ */
+static
+void
+thread_kick_idle(struct cpu *busy)
+{
+	unsigned i, numcpus;
+	struct cpu *c;
+
+	if (busy->c_runqueue.tl_count <= 1) {
+		return;
+	}
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c != busy && c->c_isidle) {
+			ipi_send(c, IPI_UNIDLE);
+			return;
+		}
+	}
+}
+
+/*
+ * Move the threads other cpus have woken for cpu C from its inbound
+ * wakeup list to its run queue. C must be the current cpu, and its
+ * run queue must be locked.
+ */
+static
+void
+thread_drain_wakeups(struct cpu *c)
+{
+	spinlock_data_t old;
+	struct thread *t, *next, *list;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+	COMPILE_ASSERT(sizeof(struct thread *) == sizeof(spinlock_data_t));
+
+	if (spinlock_data_get(&c->c_wakeups) == 0) {
+		return;
+	}
+
+	/* Take the whole list at once. */
+	do {
+		old = spinlock_data_get(&c->c_wakeups);
+	} while (spinlock_data_compareandswap(&c->c_wakeups, old, 0) != old);
+
+	/* It is newest first; reverse it so wakeups are served in order. */
+	list = NULL;
+	for (t = (struct thread *)old; t != NULL; t = next) {
+		next = t->t_wakenext;
+		t->t_wakenext = list;
+		list = t;
+	}
+	while ((t = list) != NULL) {
+		list = t->t_wakenext;
+		t->t_wakenext = NULL;
+		thread_enqueue(c, t);
+	}
+}
+
+/*
+ * Hand a thread to another cpu by pushing it on that cpu's inbound
+ * wakeup list, which takes no locks. The target moves it to its run
+ * queue the next time it switches threads or takes a timer tick. If
+ * the target is idle and the list was empty, it gets an IPI so it
+ * wakes up and looks; if the list wasn't empty, whoever made it
+ * nonempty has already seen to that.
+ *
+ * The idle loop checks the list after setting c_isidle, and we check
+ * c_isidle after pushing, so one side or the other always notices.
+ */
+static
+void
+thread_post_wakeup(struct cpu *targetcpu, struct thread *target)
+{
+	spinlock_data_t old;
+
+	do {
+		old = spinlock_data_get(&targetcpu->c_wakeups);
+		target->t_wakenext = (struct thread *)old;
+	} while (spinlock_data_compareandswap(&targetcpu->c_wakeups, old,
+					      (spinlock_data_t)target) != old);
+
+	if (old == 0 && targetcpu->c_isidle) {
+		ipi_send(targetcpu, IPI_UNIDLE);
+	}
+}
+
 /*
  * Make a thread runnable.
  *
- * targetcpu might be curcpu; it might not be, too. 
+ * targetcpu might be curcpu; it might not be, too. If it isn't, and
+ * we don't already hold its run queue lock, the thread goes on its
+ * inbound wakeup list instead of its run queue, so cpus waking each
+ * other's threads don't fight over run queue locks.
  */
 static
 void
 thread_make_runnable(struct thread *target, bool already_have_lock)
 {
 	struct cpu *targetcpu;
+	unsigned epoch;
 	bool isidle;
 
-	/* Lock the run queue of the target thread's cpu. */
 	targetcpu = target->t_cpu;
 
+	/* Catch up on any priority boost that happened while it slept. */
+	epoch = mlfq_epoch();
+	if (target->t_epoch != epoch) {
+		target->t_epoch = epoch;
+		thread_setlevel(target, 0);
+	}
+
+	SCHEDTRACE(STE_READY, target, targetcpu->c_number, 0);
+
+	if (!already_have_lock && targetcpu != curcpu->c_self) {
+		thread_post_wakeup(targetcpu, target);
+		return;
+	}
+
+	/* Lock the run queue of the target thread's cpu. */
 	if (already_have_lock) {
 		/* The target thread's cpu should be already locked. */
 		KASSERT(spinlock_do_i_hold(&targetcpu->c_runqueue_lock));
@@ -450,7 +902,7 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 
 	isidle = targetcpu->c_isidle;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	thread_enqueue(targetcpu, target);
 	if (isidle) {
 		/*
 		 * Other processor is idle; send interrupt to make
@@ -458,6 +910,14 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		 */
 		ipi_send(targetcpu, IPI_UNIDLE);
 	}
+	else if (target != curthread) {
+		/*
+		 * It may have to wait; see if someone else can take
+		 * it. (Not when yielding: we are about to pick the
+		 * next thread from this queue ourselves.)
+		 */
+		thread_kick_idle(targetcpu);
+	}
 
 	if (!already_have_lock) {
 		spinlock_release(&targetcpu->c_runqueue_lock);
@@ -471,14 +931,16 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
  * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
  *
  * The new thread is created in the process P. If P is null, the
- * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * process is inherited from the caller. It will start on cpu C, and
+ * if PINNED is set it will stay there.
  */
+static
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_fork_on(const char *name,
+	       struct proc *proc,
+	       struct cpu *c, bool pinned,
+	       void (*entrypoint)(void *data1, unsigned long data2),
+	       void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
@@ -487,51 +949,292 @@ thread_fork(const char *name,
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
 #endif // UW
 
-	newthread = thread_create(name);
-	if (newthread == NULL) {
-		return ENOMEM;
+	/* Reuse a dead thread and its stack if we have one handy */
+	newthread = thread_cache_get(name);
+	if (newthread == NULL) {
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
+
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
+	}
+
+	/*
+	 * Now we clone various fields from the parent thread.
+	 */
+
+	/* Thread subsystem fields */
+	newthread->t_cpu = c;
+	newthread->t_pinned = pinned;
+
+	/* Attach the new thread to its process */
+	if (proc == NULL) {
+		proc = curthread->t_proc;
+	}
+	result = proc_addthread(proc, newthread);
+	if (result) {
+		/* thread_destroy will clean up the stack */
+		thread_destroy(newthread);
+		return result;
+	}
+
+	/*
+	 * Because new threads come out holding the cpu runqueue lock
+	 * (see notes at bottom of thread_switch), we need to account
+	 * for the spllower() that will be done releasing it.
+	 */
+	newthread->t_iplhigh_count++;
+
+	/* Set up the switchframe so entrypoint() gets called */
+	switchframe_init(newthread, entrypoint, data1, data2);
+
+	/* Lock the new thread's cpu's run queue and make it runnable */
+	thread_make_runnable(newthread, false);
+
+	return 0;
+}
+
+/*
+ * Choose a cpu for a new thread: the one with the least to do, going
+ * by run queue length plus one if it's running something. Ties go to
+ * the current cpu, where the caller's working set is, unless AWAY is
+ * set, in which case they go elsewhere. The counts are read without
+ * locking; if they change under us, migration will sort it out.
+ */
+static
+struct cpu *
+thread_place(bool away)
+{
+	struct cpu *c, *me, *best;
+	unsigned i, load, bestload;
+
+	me = curcpu->c_self;
+	best = me;
+	bestload = away ? (unsigned)-1 :
+		me->c_runqueue.tl_count + (me->c_isidle ? 0 : 1);
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == me) {
+			continue;
+		}
+		load = c->c_runqueue.tl_count + (c->c_isidle ? 0 : 1);
+		if (load < bestload) {
+			best = c;
+			bestload = load;
+		}
+	}
+	return best;
+}
+
+/*
+ * The new thread goes on the least busy cpu (see thread_place).
+ */
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	return thread_fork_on(name, proc, thread_place(false), false,
+			      entrypoint, data1, data2);
+}
+
+int
+thread_fork_pinned(const char *name,
+		   struct proc *proc, unsigned cpunum,
+		   void (*entrypoint)(void *data1, unsigned long data2),
+		   void *data1, unsigned long data2)
+{
+	return thread_fork_placed(name, proc, cpunum, true,
+				  entrypoint, data1, data2);
+}
+
+int
+thread_fork_placed(const char *name,
+		   struct proc *proc, int cpunum, bool pinned,
+		   void (*entrypoint)(void *data1, unsigned long data2),
+		   void *data1, unsigned long data2)
+{
+	struct cpu *c;
+
+	switch (cpunum) {
+	    case THREAD_ANYCPU:
+		c = thread_place(false);
+		break;
+	    case THREAD_AWAYCPU:
+		c = thread_place(true);
+		break;
+	    default:
+		KASSERT(cpunum >= 0 &&
+			(unsigned)cpunum < cpuarray_num(&allcpus));
+		c = cpuarray_get(&allcpus, cpunum);
+		break;
+	}
+	return thread_fork_on(name, proc, c, pinned,
+			      entrypoint, data1, data2);
+}
+
+unsigned
+thread_numcpus(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+/*
+ * Has a thread been off its cpu long enough that its cache and TLB
+ * contents are probably gone? If so, moving it costs little.
+ */
+static
+bool
+thread_is_cold(struct thread *t)
+{
+	if (t->t_lastcpu == NULL) {
+		/* Never ran; nothing to lose. */
+		return true;
+	}
+	return t->t_lastcpu->c_hardclocks - t->t_lastrun >=
+		thread_migrate_coldticks;
+}
+
+/*
+ * Take up to N threads off cpu C's run queue, for moving to another
+ * cpu, and put them on the list OUT. Cold threads are taken first,
+ * working from the tail of the queue (the lowest priorities); only if
+ * there aren't enough of those are warm ones taken. Returns the
+ * number of threads taken. C's run queue must be locked.
+ *
+ * Ordinarily, C's current thread will not appear on its run queue.
+ * However, it can under the following circumstances:
+ *   - it went to sleep;
+ *   - the processor became idle, so it remained curthread;
+ *   - it was reawakened, so it was put on the run queue;
+ *   - and the processor hasn't fully unidled yet, so all these
+ *     things are still true.
+ *
+ * If we look at exactly the proper moment, we can see it here while
+ * things are in this state. However, *migrating* it can cause bad
+ * things to happen (Exercise: Why? And what?) so it is skipped.
+ * Pinned threads are skipped too, as are EDF threads, which were
+ * admitted against this cpu's capacity.
+ */
+static
+unsigned
+thread_pick_migrants(struct cpu *c, unsigned n, struct threadlist *out)
+{
+	struct threadlistnode *tln, *prev;
+	struct thread *t;
+	unsigned taken;
+	int pass;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	taken = 0;
+	for (pass = 0; pass < 2; pass++) {
+		for (tln = c->c_runqueue.tl_tail.tln_prev;
+		     tln->tln_prev != NULL && taken < n;
+		     tln = prev) {
+			prev = tln->tln_prev;
+			t = tln->tln_self;
+			if (t == c->c_curthread || t->t_pinned ||
+			    t->t_edf_period != 0) {
+				continue;
+			}
+			if (pass == 0 && !thread_is_cold(t)) {
+				continue;
+			}
+			threadlist_remove(&c->c_runqueue, t);
+			threadlist_addtail(out, t);
+			taken++;
+		}
+	}
+	return taken;
+}
+
+/*
+ * Work stealing.
+ *
+ * Called by a cpu that has run out of work, with its own run queue
+ * unlocked, before it halts in cpu_idle. Takes up to half the threads
+ * from the tail of the busiest other cpu's run queue. The tail is
+ * where the lowest-priority threads are, which are the ones that
+ * would otherwise wait longest.
+ *
+ * Queue lengths are sampled without locking, and a victim whose run
+ * queue is locked is skipped rather than spun on, so a cpu never
+ * spends more than STEAL_ATTEMPTS lock attempts here before idling.
+ *
+ * Returns true if anything was stolen.
+ */
+static
+bool
+thread_steal(void)
+{
+	struct cpu *c, *victim;
+	struct threadlist stolen;
+	struct thread *t;
+	uint32_t tried;
+	unsigned i, numcpus, best, tosteal, attempt;
+
+	numcpus = cpuarray_num(&allcpus);
+	threadlist_init(&stolen);
+	tried = 0;
+
+	for (attempt = 0; attempt < STEAL_ATTEMPTS; attempt++) {
+		victim = NULL;
+		best = 0;
+		for (i=0; i<numcpus && i<32; i++) {
+			c = cpuarray_get(&allcpus, i);
+			if (c == curcpu->c_self || (tried & (1U << i))) {
+				continue;
+			}
+			if (c->c_runqueue.tl_count > best) {
+				best = c->c_runqueue.tl_count;
+				victim = c;
+			}
+		}
+		if (victim == NULL) {
+			break;
+		}
+		tried |= 1U << victim->c_number;
+
+		if (!spinlock_tryacquire(&victim->c_runqueue_lock)) {
+			continue;
+		}
+		tosteal = DIVROUNDUP(victim->c_runqueue.tl_count, 2);
+		tosteal = thread_pick_migrants(victim, tosteal, &stolen);
+		victim->c_migrated_out += tosteal;
+		spinlock_release(&victim->c_runqueue_lock);
+
+		if (tosteal > 0) {
+			DEBUG(DB_THREADS, "cpu %u stole %u threads from cpu %u\n",
+			      curcpu->c_number, tosteal, victim->c_number);
+			break;
+		}
 	}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+	if (threadlist_isempty(&stolen)) {
+		threadlist_cleanup(&stolen);
+		return false;
 	}
-	thread_checkstack_init(newthread);
-
-	/*
-	 * Now we clone various fields from the parent thread.
-	 */
-
-	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
 
-	/* Attach the new thread to its process */
-	if (proc == NULL) {
-		proc = curthread->t_proc;
-	}
-	result = proc_addthread(proc, newthread);
-	if (result) {
-		/* thread_destroy will clean up the stack */
-		thread_destroy(newthread);
-		return result;
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	while ((t = threadlist_remhead(&stolen)) != NULL) {
+		SCHEDTRACE(STE_MIGRATE, t, victim->c_number, curcpu->c_number);
+		t->t_cpu = curcpu->c_self;
+		thread_enqueue(curcpu->c_self, t);
+		curcpu->c_migrated_in++;
 	}
+	spinlock_release(&curcpu->c_runqueue_lock);
 
-	/*
-	 * Because new threads come out holding the cpu runqueue lock
-	 * (see notes at bottom of thread_switch), we need to account
-	 * for the spllower() that will be done releasing it.
-	 */
-	newthread->t_iplhigh_count++;
-
-	/* Set up the switchframe so entrypoint() gets called */
-	switchframe_init(newthread, entrypoint, data1, data2);
-
-	/* Lock the current cpu's run queue and make the new thread runnable */
-	thread_make_runnable(newthread, false);
-
-	return 0;
+	threadlist_cleanup(&stolen);
+	return true;
 }
 
 /*
@@ -570,8 +1273,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Check the stack guard band. */
 	thread_checkstack(cur);
 
-	/* Lock the run queue. */
+	/* Lock the run queue, and pick up anything woken from elsewhere. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
+	thread_drain_wakeups(curcpu->c_self);
 
 	/* Micro-optimization: if nothing to do, just return */
 	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
@@ -585,9 +1289,18 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
+		cur->t_usage.cu_nivcsw++;
 		thread_make_runnable(cur, true /*have lock*/);
 		break;
 	    case S_SLEEP:
+		cur->t_usage.cu_nvcsw++;
+		/*
+		 * Blocking gives up the rest of the time slice without
+		 * being charged for it, so threads that mostly wait
+		 * (for the console, the disk, their children) keep
+		 * their priority.
+		 */
+		cur->t_ticks = 0;
 		cur->t_wchan_name = wc->wc_name;
 		/*
 		 * Add the thread to the list in the wait channel, and
@@ -603,6 +1316,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		 * without racing. Exercise: what's the other?)
 		 */
 		threadlist_addtail(&wc->wc_threads, cur);
+		cur->t_wchan = wc;
 		wchan_unlock(wc);
 		break;
 	    case S_ZOMBIE:
@@ -612,6 +1326,10 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	}
 	cur->t_state = newstate;
 
+	/* Remember when and where it ran, for the migration code. */
+	cur->t_lastcpu = curcpu->c_self;
+	cur->t_lastrun = curcpu->c_hardclocks;
+
 	/*
 	 * Get the next thread. While there isn't one, call md_idle().
 	 * curcpu->c_isidle must be true when md_idle is
@@ -632,14 +1350,29 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
 	do {
+		thread_drain_wakeups(curcpu->c_self);
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			if (!thread_steal()) {
+				hardclock_idle();
+				cpu_idle();
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
+	hardclock_unidle();
+
+	/* Advance the fair-share clock. */
+	if (!thread_edf_active(next) &&
+	    (int)(next->t_pass - curcpu->c_vtime) > 0) {
+		curcpu->c_vtime = next->t_pass;
+	}
+
+	SCHEDTRACE(STE_SWITCH, cur, (uintptr_t)next,
+		   newstate == S_READY ? STE_YIELDED :
+		   newstate == S_SLEEP ? STE_BLOCKED : STE_EXITED);
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -799,6 +1532,11 @@ thread_exit(void)
 	/* Make sure we *are* detached (move this only if you're sure!) */
 	KASSERT(cur->t_proc == NULL);
 
+	/* Give back any EDF reservation. */
+	if (cur->t_edf_period != 0) {
+		thread_edf_set(0, 0);
+	}
+
 	/* Check the stack guard band. */
 	thread_checkstack(cur);
 
@@ -824,15 +1562,321 @@ thread_yield(void)
  *
  * This is called periodically from hardclock(). It should reshuffle
  * the current CPU's run queue by job priority.
+ *
+ * Threads are scheduled with a multi-level feedback queue. The run
+ * queue is kept sorted by level (see thread_enqueue), so the actual
+ * choice of the next thread in thread_switch stays a remhead. New
+ * threads start at level 0; a thread that uses up its whole quantum
+ * is demoted one level (thread_timeslice), and lower levels get
+ * longer quanta. Threads that block instead keep their level.
+ *
+ * EDF threads (see thread_edf_set) go ahead of all of this. An EDF
+ * thread that has run out of budget drops back among the best-effort
+ * threads; schedule() moves it forward again once its next period
+ * has started.
+ *
+ * What's left for schedule() is the periodic priority boost, which
+ * puts everything on this cpu back at level 0 so CPU-bound threads
+ * that have sunk to the bottom still get to run. Sleeping threads
+ * pick up the boost when they're next made runnable, by noticing
+ * that mlfq_epoch() has moved.
  */
-
 void
 schedule(void)
 {
+	struct threadlistnode *tln, *next;
+	struct threadlist boosted;
+	struct thread *t;
+	unsigned epoch;
+
+	if (curcpu->c_edf_util != 0) {
+		spinlock_acquire(&curcpu->c_runqueue_lock);
+		for (tln = curcpu->c_runqueue.tl_head.tln_next;
+		     tln->tln_next != NULL;
+		     tln = next) {
+			next = tln->tln_next;
+			t = tln->tln_self;
+			if (t->t_edf_period != 0 &&
+			    (int)(curcpu->c_hardclocks -
+				  t->t_edf_deadline) >= 0) {
+				/* Requeueing starts its new period. */
+				threadlist_remove(&curcpu->c_runqueue, t);
+				thread_enqueue(curcpu->c_self, t);
+			}
+		}
+		spinlock_release(&curcpu->c_runqueue_lock);
+	}
+
+	/* Boost once per epoch, whenever this cpu first sees it. */
+	epoch = mlfq_epoch();
+	if (curcpu->c_boostepoch == epoch) {
+		return;
+	}
+	curcpu->c_boostepoch = epoch;
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
 	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
+	 * Everything ends up at level 0, in fair-share order, so take
+	 * the whole queue off and put it back.
 	 */
+	threadlist_init(&boosted);
+	while ((t = threadlist_remhead(&curcpu->c_runqueue)) != NULL) {
+		thread_setlevel(t, 0);
+		t->t_epoch = epoch;
+		threadlist_addtail(&boosted, t);
+	}
+	while ((t = threadlist_remhead(&boosted)) != NULL) {
+		thread_enqueue(curcpu->c_self, t);
+	}
+	threadlist_cleanup(&boosted);
+	thread_setlevel(curthread, 0);
+	curthread->t_epoch = epoch;
+	spinlock_release(&curcpu->c_runqueue_lock);
+}
+
+/*
+ * Time slicing.
+ *
+ * This is called from hardclock() on every tick. The tick is charged
+ * to the current thread; if that finishes its quantum, the thread is
+ * demoted and given the (longer) quantum of its new level. Either
+ * way it is only preempted if some other thread is waiting: at any
+ * level once the quantum is used up, and otherwise only at a better
+ * level than its own. The tick also counts against the thread's
+ * process's fair share, which decides the order within a level but
+ * doesn't cut a quantum short.
+ *
+ * An EDF thread is charged against its budget instead, and has no
+ * quantum: it runs until it blocks, runs out of budget, or a thread
+ * with an earlier deadline turns up.
+ *
+ * The run queue length is looked at without the lock, so that the
+ * common case of a cpu with one thing to do costs no locking at all.
+ * A thread that arrives just after we look is picked up on the next
+ * tick.
+ */
+void
+thread_timeslice(void)
+{
+	struct thread *cur, *next;
+	bool preempt, exhausted;
+
+	cur = curthread;
+
+	/* Nothing to charge if the timer interrupted the idle loop. */
+	if (curcpu->c_isidle) {
+		return;
+	}
+
+	if (spinlock_data_get(&curcpu->c_wakeups) != 0) {
+		spinlock_acquire(&curcpu->c_runqueue_lock);
+		thread_drain_wakeups(curcpu->c_self);
+		spinlock_release(&curcpu->c_runqueue_lock);
+	}
+
+	if (cur->t_edf_period != 0) {
+		spinlock_acquire(&curcpu->c_runqueue_lock);
+		thread_edf_refresh(cur);
+		exhausted = false;
+		if (thread_edf_active(cur)) {
+			cur->t_edf_used++;
+			exhausted = !thread_edf_active(cur);
+		}
+		spinlock_release(&curcpu->c_runqueue_lock);
+		if (exhausted) {
+			if (curcpu->c_runqueue.tl_count > 0) {
+				thread_yield();
+			}
+			return;
+		}
+	}
+
+	if (!thread_edf_active(cur)) {
+		thread_share_charge(cur);
+		cur->t_ticks++;
+		if (cur->t_ticks >= cur->t_quantum) {
+			thread_setlevel(cur, cur->t_priority < MLFQ_NLEVELS - 1 ?
+					cur->t_priority + 1 : cur->t_priority);
+			if (curcpu->c_runqueue.tl_count > 0) {
+				thread_yield();
+			}
+			return;
+		}
+	}
+
+	if (curcpu->c_runqueue.tl_count == 0) {
+		return;
+	}
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	/* (the tail bookend's tln_self is NULL if the queue is empty) */
+	next = curcpu->c_runqueue.tl_head.tln_next->tln_self;
+	preempt = (next != NULL && thread_outranks(next, cur));
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	if (preempt) {
+		thread_yield();
+	}
+}
+
+/*
+ * Put a thread at a feedback queue level, with a fresh quantum.
+ */
+void
+thread_setlevel(struct thread *t, int level)
+{
+	KASSERT(level >= 0 && level < MLFQ_NLEVELS);
+
+	t->t_priority = level;
+	t->t_quantum = mlfq_quantum[level];
+	t->t_ticks = 0;
+}
+
+/*
+ * Return the effective priority of a thread.
+ */
+int
+thread_priority(struct thread *t)
+{
+	return t->t_donated < t->t_priority ? t->t_donated : t->t_priority;
+}
+
+/*
+ * A thread's effective priority has improved (someone donated to
+ * it). If it's waiting on a run queue, requeue it so it moves ahead
+ * of the threads it now outranks. If it's running, asleep, or in
+ * transit between cpus, there's nothing to do; the new priority is
+ * used the next time it is queued.
+ */
+void
+thread_reprioritize(struct thread *t)
+{
+	struct cpu *c;
+	struct threadlistnode *tln;
+
+	c = t->t_cpu;
+	if (c == NULL) {
+		return;
+	}
+
+	spinlock_acquire(&c->c_runqueue_lock);
+	/* Make sure it wasn't migrated while we weren't looking. */
+	if (t->t_cpu == c) {
+		for (tln = c->c_runqueue.tl_head.tln_next;
+		     tln->tln_next != NULL;
+		     tln = tln->tln_next) {
+			if (tln->tln_self == t) {
+				threadlist_remove(&c->c_runqueue, t);
+				thread_enqueue(c, t);
+				break;
+			}
+		}
+	}
+	spinlock_release(&c->c_runqueue_lock);
+}
+
+/*
+ * Earliest deadline first.
+ *
+ * A thread can ask for BUDGET hardclocks of cpu time in every PERIOD
+ * hardclocks, each period's work being due by the end of the period.
+ * EDF threads are partitioned: each is admitted against the capacity
+ * of the cpu it's on when it asks, and then never migrates, so as long
+ * as the budgets on a cpu add up to no more than the cpu, every
+ * deadline can be met. Admission keeps the total under EDF_MAXUTIL so
+ * best-effort threads aren't starved outright. Budgets are enforced
+ * by thread_timeslice; periods that end with the work not done (the
+ * thread hasn't called thread_edf_wait) are counted as misses.
+ *
+ * Set the current thread's reservation. PERIOD 0 makes it a
+ * best-effort thread again. Returns EINVAL for a budget that is
+ * empty or longer than the period, and EBUSY if the cpu hasn't got
+ * room.
+ */
+int
+thread_edf_set(unsigned period, unsigned budget)
+{
+	struct thread *cur = curthread;
+	struct cpu *c;
+	unsigned util, oldutil;
+	int spl;
+
+	if (period != 0 && (budget == 0 || budget > period)) {
+		return EINVAL;
+	}
+	util = period == 0 ? 0 : DIVROUNDUP(budget * 1000, period);
+
+	/* Hold still while we look at which cpu we're on. */
+	spl = splhigh();
+	c = curcpu->c_self;
+	KASSERT(cur->t_cpu == c);
+	spinlock_acquire(&c->c_runqueue_lock);
+
+	oldutil = cur->t_edf_period == 0 ? 0 :
+		DIVROUNDUP(cur->t_edf_budget * 1000, cur->t_edf_period);
+	if (c->c_edf_util - oldutil + util > EDF_MAXUTIL) {
+		spinlock_release(&c->c_runqueue_lock);
+		splx(spl);
+		return EBUSY;
+	}
+	c->c_edf_util = c->c_edf_util - oldutil + util;
+
+	if (cur->t_edf_period == 0) {
+		cur->t_edf_misses = 0;
+	}
+	cur->t_edf_period = period;
+	cur->t_edf_budget = budget;
+	cur->t_edf_used = 0;
+	cur->t_edf_deadline = c->c_hardclocks + period;
+	cur->t_edf_done = false;
+
+	spinlock_release(&c->c_runqueue_lock);
+	splx(spl);
+	return 0;
+}
+
+/*
+ * The current EDF thread has finished this period's work; sleep
+ * until the next period starts.
+ */
+int
+thread_edf_wait(void)
+{
+	struct thread *cur = curthread;
+	unsigned left;
+	int spl;
+
+	if (cur->t_edf_period == 0) {
+		return EINVAL;
+	}
+
+	spl = splhigh();
+	cur->t_edf_done = true;
+	left = cur->t_edf_deadline - curcpu->c_hardclocks;
+	splx(spl);
+
+	if ((int)left > 0) {
+		timeout_sleep(timeout_ticks(left / HZ,
+					    (left % HZ) * (1000000000 / HZ)));
+	}
+	return 0;
+}
+
+/*
+ * Print each cpu's EDF reservations and deadline misses.
+ */
+void
+thread_print_edf(void)
+{
+	unsigned i;
+	struct cpu *c;
+
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("cpu%u: %u.%u%% reserved by EDF threads, %u misses\n",
+			c->c_number, c->c_edf_util / 10, c->c_edf_util % 10,
+			c->c_edf_misses);
+	}
 }
 
 /*
@@ -848,9 +1892,18 @@ schedule(void)
  * and the performance loss due to underutilization of some CPUs is
  * something that needs to be tuned and probably is workload-specific.
  *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * So there are two knobs. We only push work away when we have more
+ * than thread_migrate_hysteresis threads beyond our fair share, so
+ * small or momentary imbalances don't make threads bounce back and
+ * forth. And when we do, we prefer threads that haven't run for at
+ * least thread_migrate_coldticks hardclocks, whose cache and TLB
+ * contents have most likely been displaced anyway (see
+ * thread_pick_migrants). Both can be set from the kernel menu, which
+ * can also print how many threads each cpu has given and taken.
+ *
+ * Threads aren't sent to a cpu whose one-minute load average is well
+ * over the share, even if its run queue happens to be short just now:
+ * its threads are probably only blocked for a moment.
  */
 void
 thread_consider_migration(void)
@@ -874,17 +1927,14 @@ thread_consider_migration(void)
 	}
 
 	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
+	if (my_count <= one_share + thread_migrate_hysteresis) {
 		return;
 	}
 
-	to_send = my_count - one_share;
 	threadlist_init(&victims);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
-	}
+	to_send = thread_pick_migrants(curcpu->c_self, my_count - one_share,
+				       &victims);
 	spinlock_release(&curcpu->c_runqueue_lock);
 
 	for (i=0; i < numcpus && to_send > 0; i++) {
@@ -892,39 +1942,19 @@ thread_consider_migration(void)
 		if (c == curcpu->c_self) {
 			continue;
 		}
+		if (c->c_loadavg[0] > (one_share + 1 + thread_migrate_hysteresis)
+		    * LOADAVG_FSCALE) {
+			continue;
+		}
 		spinlock_acquire(&c->c_runqueue_lock);
 		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
 			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
-
+			SCHEDTRACE(STE_MIGRATE, t, curcpu->c_number,
+				   c->c_number);
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			thread_enqueue(c, t);
+			curcpu->c_migrated_out++;
+			c->c_migrated_in++;
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -948,7 +1978,7 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			thread_enqueue(curcpu->c_self, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -957,6 +1987,64 @@ thread_consider_migration(void)
 	threadlist_cleanup(&victims);
 }
 
+void
+cpuusage_add(struct cpuusage *to, const struct cpuusage *from)
+{
+	to->cu_utime += from->cu_utime;
+	to->cu_stime += from->cu_stime;
+	to->cu_nvcsw += from->cu_nvcsw;
+	to->cu_nivcsw += from->cu_nivcsw;
+}
+
+/*
+ * Print a load average to two decimal places.
+ */
+static
+void
+thread_print_loadavg(unsigned load)
+{
+	load = (load * 100 + LOADAVG_FSCALE / 2) >> LOADAVG_FSHIFT;
+	kprintf(" %u.%02u", load / 100, load % 100);
+}
+
+/*
+ * Print each cpu's busy and idle time and its load averages.
+ */
+void
+thread_print_cpustats(void)
+{
+	unsigned i, j;
+	struct cpu *c;
+
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("cpu%u: %u busy, %u idle hardclocks; load average",
+			c->c_number, c->c_busyticks, c->c_idleticks);
+		for (j=0; j<LOADAVG_NAVG; j++) {
+			thread_print_loadavg(c->c_loadavg[j]);
+		}
+		kprintf("\n");
+	}
+}
+
+/*
+ * Print the migration tunables and per-cpu migration counts.
+ */
+void
+thread_print_migrations(void)
+{
+	unsigned i;
+	struct cpu *c;
+
+	kprintf("Migration: cold after %u hardclocks, hysteresis %u threads\n",
+		thread_migrate_coldticks, thread_migrate_hysteresis);
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("cpu%u: %u migrated in, %u migrated out\n",
+			c->c_number, c->c_migrated_in, c->c_migrated_out);
+	}
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -1025,6 +2113,7 @@ wchan_sleep(struct wchan *wc)
 	/* may not sleep in an interrupt handler */
 	KASSERT(!curthread->t_in_interrupt);
 
+	SCHEDTRACE(STE_SLEEP, curthread, (uintptr_t)wc, 0);
 	thread_switch(S_SLEEP, wc);
 }
 
@@ -1039,6 +2128,9 @@ wchan_wakeone(struct wchan *wc)
 	/* Lock the channel and grab a thread from it */
 	spinlock_acquire(&wc->wc_lock);
 	target = threadlist_remhead(&wc->wc_threads);
+	if (target != NULL) {
+		target->t_wchan = NULL;
+	}
 	/*
 	 * Nobody else can wake up this thread now, so we don't need
 	 * to hang onto the lock.
@@ -1050,6 +2142,59 @@ wchan_wakeone(struct wchan *wc)
 		return;
 	}
 
+	SCHEDTRACE(STE_WAKE, target, (uintptr_t)wc, 0);
+	thread_make_runnable(target, false);
+}
+
+/*
+ * Wake up one particular thread sleeping on a wait channel.
+ *
+ * Don't look at its t_state: thread_switch puts a thread on the
+ * channel and unlocks it before setting S_SLEEP, so we can get here
+ * while it still says S_RUN. Being on the list is what counts, and
+ * t_wchan, set while it is, says so without searching the list.
+ */
+void
+wchan_wakethread(struct wchan *wc, struct thread *target)
+{
+	spinlock_acquire(&wc->wc_lock);
+	KASSERT(target->t_wchan == wc);
+	threadlist_remove(&wc->wc_threads, target);
+	target->t_wchan = NULL;
+	spinlock_release(&wc->wc_lock);
+
+	SCHEDTRACE(STE_WAKE, target, (uintptr_t)wc, 0);
+	thread_make_runnable(target, false);
+}
+
+/*
+ * Wake up the most urgent thread sleeping on a wait channel.
+ */
+void
+wchan_wakebest(struct wchan *wc)
+{
+	struct thread *target;
+	struct threadlistnode *tln;
+
+	spinlock_acquire(&wc->wc_lock);
+	target = NULL;
+	for (tln = wc->wc_threads.tl_head.tln_next; tln->tln_self != NULL;
+	     tln = tln->tln_next) {
+		if (target == NULL || thread_outranks(tln->tln_self, target)) {
+			target = tln->tln_self;
+		}
+	}
+	if (target != NULL) {
+		threadlist_remove(&wc->wc_threads, target);
+		target->t_wchan = NULL;
+	}
+	spinlock_release(&wc->wc_lock);
+
+	if (target == NULL) {
+		return;
+	}
+
+	SCHEDTRACE(STE_WAKE, target, (uintptr_t)wc, 0);
 	thread_make_runnable(target, false);
 }
 
@@ -1070,6 +2215,7 @@ wchan_wakeall(struct wchan *wc)
 	 */
 	spinlock_acquire(&wc->wc_lock);
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 	/*
@@ -1084,6 +2230,7 @@ wchan_wakeall(struct wchan *wc)
 	 * make each thread runnable.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
+		SCHEDTRACE(STE_WAKE, target, (uintptr_t)wc, 0);
 		thread_make_runnable(target, false);
 	}
 
@@ -1120,6 +2267,7 @@ ipi_send(struct cpu *target, int code)
 {
 	KASSERT(code >= 0 && code < 32);
 
+	SCHEDTRACE(STE_IPI, NULL, target->c_number, code);
 	spinlock_acquire(&target->c_ipi_lock);
 	target->c_ipi_pending |= (uint32_t)1 << code;
 	mainbus_send_ipi(target);
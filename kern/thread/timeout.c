@@ -0,0 +1,358 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Timeouts, kept in a hierarchical timing wheel.
+ *
+ * There are WHEEL_LEVELS levels of WHEEL_SLOTS slots each. A timeout
+ * due within WHEEL_SLOTS ticks goes in level 0, in the slot for its
+ * exact expiry tick. One due later goes in the first level whose range
+ * covers it, in the slot picked by the corresponding bits of its
+ * expiry tick. Whenever the low bits of the clock roll over to zero,
+ * the next slot of the level above is emptied and its timeouts are
+ * placed again, which moves them down to a finer level. So each tick
+ * touches only the timeouts due then, plus an occasional slot's worth
+ * being cascaded, no matter how many are pending.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <timeout.h>
+#include <lamebus/ltimer.h>
+
+#define WHEEL_BITS	6
+#define WHEEL_SLOTS	(1U << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS	4
+#define WHEEL_SPAN	(1U << (WHEEL_BITS * WHEEL_LEVELS))
+
+/* Ticks per second */
+#define TICKS_PER_SECOND	(1000000 / LT_GRANULARITY)
+
+/*
+ * The wheel, and the next tick to be processed. Everything here is
+ * protected by wheel_lock.
+ */
+static struct spinlock wheel_lock = SPINLOCK_INITIALIZER;
+static struct timeout *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static unsigned wheel_now;
+
+/* Wait channel for timeout_sleep; its sleepers are woken one by one. */
+static struct wchan *timeout_wchan;
+
+/*
+ * Setup.
+ */
+void
+timeout_bootstrap(void)
+{
+	timeout_wchan = wchan_create("timeout");
+	if (timeout_wchan == NULL) {
+		panic("Couldn't create timeout wchan\n");
+	}
+}
+
+/*
+ * Put a timeout in the slot it belongs in, given the current time.
+ * Timeouts too far off to fit go in the last slot they can reach,
+ * and are placed again when that slot is cascaded.
+ */
+static
+void
+timeout_place(struct timeout *to)
+{
+	struct timeout **slotp;
+	unsigned delta, when, level;
+
+	KASSERT(spinlock_do_i_hold(&wheel_lock));
+
+	delta = to->to_expire - wheel_now;
+	if (delta >= WHEEL_SPAN) {
+		delta = WHEEL_SPAN - 1;
+	}
+	when = wheel_now + delta;
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < (1U << (WHEEL_BITS * (level + 1)))) {
+			break;
+		}
+	}
+	slotp = &wheel[level][(when >> (WHEEL_BITS * level)) & WHEEL_MASK];
+
+	to->to_next = *slotp;
+	if (to->to_next != NULL) {
+		to->to_next->to_pprev = &to->to_next;
+	}
+	to->to_pprev = slotp;
+	*slotp = to;
+}
+
+/*
+ * Take a timeout off whatever list it's on.
+ */
+static
+void
+timeout_unlink(struct timeout *to)
+{
+	KASSERT(spinlock_do_i_hold(&wheel_lock));
+	KASSERT(to->to_pending);
+
+	*to->to_pprev = to->to_next;
+	if (to->to_next != NULL) {
+		to->to_next->to_pprev = to->to_pprev;
+	}
+	to->to_next = NULL;
+	to->to_pprev = NULL;
+	to->to_pending = false;
+}
+
+/*
+ * Empty one slot of a coarser level, placing its timeouts again.
+ */
+static
+void
+timeout_cascade(unsigned level, unsigned slot)
+{
+	struct timeout *to, *next;
+
+	to = wheel[level][slot];
+	wheel[level][slot] = NULL;
+	for (; to != NULL; to = next) {
+		next = to->to_next;
+		timeout_place(to);
+	}
+}
+
+/*
+ * Called once per tick, on one cpu, from timerclock().
+ *
+ * Due timeouts are run one at a time without the wheel lock held, so
+ * they can add or cancel timeouts. The list of due timeouts is still
+ * updated only under the lock, so a timeout on it can be cancelled
+ * from another cpu before it runs.
+ */
+void
+timeout_tick(void)
+{
+	struct timeout *due, *to;
+	void (*func)(void *);
+	void *arg;
+	unsigned level;
+
+	spinlock_acquire(&wheel_lock);
+
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		if ((wheel_now & ((1U << (WHEEL_BITS * level)) - 1)) != 0) {
+			break;
+		}
+		timeout_cascade(level,
+				(wheel_now >> (WHEEL_BITS * level)) & WHEEL_MASK);
+	}
+
+	due = wheel[0][wheel_now & WHEEL_MASK];
+	wheel[0][wheel_now & WHEEL_MASK] = NULL;
+	if (due != NULL) {
+		due->to_pprev = &due;
+	}
+	wheel_now++;
+
+	while ((to = due) != NULL) {
+		timeout_unlink(to);
+		func = to->to_func;
+		arg = to->to_arg;
+		/* TO may be reused or freed as soon as FUNC is called. */
+		spinlock_release(&wheel_lock);
+		func(arg);
+		spinlock_acquire(&wheel_lock);
+	}
+
+	spinlock_release(&wheel_lock);
+}
+
+unsigned
+timeout_now(void)
+{
+	return wheel_now;
+}
+
+unsigned
+timeout_ticks(time_t secs, uint32_t nsecs)
+{
+	const unsigned maxsecs = 0x7fffffff / TICKS_PER_SECOND - 1;
+
+	if (secs < 0) {
+		return 0;
+	}
+	if (secs > maxsecs) {
+		/* Good enough for forever. */
+		secs = maxsecs;
+	}
+	return (unsigned)secs * TICKS_PER_SECOND +
+		DIVROUNDUP(nsecs, LT_GRANULARITY * 1000);
+}
+
+void
+timeout_init(struct timeout *to, void (*func)(void *), void *arg)
+{
+	to->to_next = NULL;
+	to->to_pprev = NULL;
+	to->to_expire = 0;
+	to->to_pending = false;
+	to->to_func = func;
+	to->to_arg = arg;
+}
+
+void
+timeout_add(struct timeout *to, unsigned ticks)
+{
+	KASSERT(to->to_func != NULL);
+
+	spinlock_acquire(&wheel_lock);
+	KASSERT(!to->to_pending);
+	to->to_expire = wheel_now + ticks;
+	to->to_pending = true;
+	timeout_place(to);
+	spinlock_release(&wheel_lock);
+}
+
+bool
+timeout_cancel(struct timeout *to)
+{
+	bool ret;
+
+	spinlock_acquire(&wheel_lock);
+	ret = to->to_pending;
+	if (ret) {
+		timeout_unlink(to);
+	}
+	spinlock_release(&wheel_lock);
+
+	return ret;
+}
+
+/*
+ * Timed sleep.
+ *
+ * The timeout lives on the sleeper's stack. It is added while the
+ * sleeper holds the wait channel lock, which it doesn't let go of
+ * until it is on the channel, so by the time timeout_wakeup can lock
+ * the channel the sleeper is there to be woken.
+ */
+static
+void
+timeout_wakeup(void *data)
+{
+	wchan_wakethread(timeout_wchan, data);
+}
+
+void
+timeout_sleep(unsigned ticks)
+{
+	struct timeout to;
+
+	if (ticks == 0) {
+		return;
+	}
+
+	timeout_init(&to, timeout_wakeup, curthread);
+	wchan_lock(timeout_wchan);
+	timeout_add(&to, ticks);
+	wchan_sleep(timeout_wchan);
+	KASSERT(!to.to_pending);
+}
+
+/*
+ * For the interruptible kind, the sleeper publishes its timeout in
+ * t_sleepto in the same wheel_lock section that makes it pending. If
+ * timeout_stopsleep then finds it pending and takes it out, nothing
+ * else can wake the sleeper, so its stack (and the timeout) stay put
+ * until timeout_wakesleeper.
+ */
+int
+timeout_sleep_intr(unsigned ticks)
+{
+	struct timeout to;
+	struct thread *cur = curthread;
+	bool stopped;
+
+	if (ticks == 0) {
+		return 0;
+	}
+
+	timeout_init(&to, timeout_wakeup, cur);
+	wchan_lock(timeout_wchan);
+	spinlock_acquire(&wheel_lock);
+	if (cur->t_nosleep) {
+		spinlock_release(&wheel_lock);
+		wchan_unlock(timeout_wchan);
+		return EINTR;
+	}
+	to.to_expire = wheel_now + ticks;
+	to.to_pending = true;
+	timeout_place(&to);
+	cur->t_sleepto = &to;
+	spinlock_release(&wheel_lock);
+
+	wchan_sleep(timeout_wchan);
+
+	spinlock_acquire(&wheel_lock);
+	KASSERT(!to.to_pending);
+	cur->t_sleepto = NULL;
+	stopped = cur->t_nosleep;
+	spinlock_release(&wheel_lock);
+
+	return stopped ? EINTR : 0;
+}
+
+bool
+timeout_stopsleep(struct thread *t)
+{
+	bool ret;
+
+	spinlock_acquire(&wheel_lock);
+	t->t_nosleep = true;
+	ret = t->t_sleepto != NULL && t->t_sleepto->to_pending;
+	if (ret) {
+		timeout_unlink(t->t_sleepto);
+	}
+	spinlock_release(&wheel_lock);
+
+	return ret;
+}
+
+void
+timeout_wakesleeper(struct thread *t)
+{
+	wchan_wakethread(timeout_wchan, t);
+}
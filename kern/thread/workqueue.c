@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Work queues. See workqueue.h.
+ *
+ * Each cpu has its own list of work, protected by its own spinlock,
+ * and its own worker thread, pinned to it. A work item's w_pending
+ * word is claimed with test-and-set when it is queued and cleared by
+ * the worker just before it calls the function, so an item is never
+ * on two lists at once no matter which cpus queue it.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <cpu.h>
+#include <proc.h>
+#include <workqueue.h>
+
+struct wq_cpu {
+	struct spinlock wc_lock;	/* Protects the rest */
+	struct wchan *wc_wchan;		/* Where the worker sleeps */
+	struct work *wc_head;		/* Queued work */
+	struct work **wc_tailp;		/* Where to append */
+	bool wc_exiting;		/* Worker should quit when empty */
+};
+
+struct workqueue {
+	char *wq_name;
+	unsigned wq_ncpus;
+	struct wq_cpu *wq_cpus;		/* One per cpu */
+	struct semaphore *wq_done;	/* V'd by each worker as it quits */
+};
+
+struct workqueue *system_wq;
+
+/*
+ * Worker thread: run the work queued on cpu N until told to quit.
+ */
+static
+void
+workqueue_worker(void *data1, unsigned long n)
+{
+	struct workqueue *wq = data1;
+	struct wq_cpu *wc = &wq->wq_cpus[n];
+	struct work *w;
+	void (*func)(void *);
+	void *arg;
+
+	spinlock_acquire(&wc->wc_lock);
+	while (1) {
+		w = wc->wc_head;
+		if (w == NULL) {
+			if (wc->wc_exiting) {
+				break;
+			}
+			/* Same bridge to the wchan lock as in P(). */
+			wchan_lock(wc->wc_wchan);
+			spinlock_release(&wc->wc_lock);
+			wchan_sleep(wc->wc_wchan);
+			spinlock_acquire(&wc->wc_lock);
+			continue;
+		}
+
+		wc->wc_head = w->w_next;
+		if (wc->wc_head == NULL) {
+			wc->wc_tailp = &wc->wc_head;
+		}
+		func = w->w_func;
+		arg = w->w_arg;
+		spinlock_data_set(&w->w_pending, 0);
+		spinlock_release(&wc->wc_lock);
+
+		func(arg);
+
+		spinlock_acquire(&wc->wc_lock);
+	}
+	spinlock_release(&wc->wc_lock);
+
+	V(wq->wq_done);
+}
+
+/*
+ * Add a work item, already marked pending, to the current cpu's list.
+ */
+static
+void
+workqueue_add(struct workqueue *wq, struct work *w)
+{
+	struct wq_cpu *wc;
+
+	/*
+	 * If we get moved to another cpu after looking at curcpu, the
+	 * work just runs on the cpu we were on. That's fine.
+	 */
+	wc = &wq->wq_cpus[curcpu->c_number];
+
+	spinlock_acquire(&wc->wc_lock);
+	w->w_next = NULL;
+	*wc->wc_tailp = w;
+	wc->wc_tailp = &w->w_next;
+	spinlock_release(&wc->wc_lock);
+
+	wchan_wakeone(wc->wc_wchan);
+}
+
+/*
+ * Tell the first N workers to quit, and wait for them to do so.
+ */
+static
+void
+workqueue_stop(struct workqueue *wq, unsigned n)
+{
+	struct wq_cpu *wc;
+	unsigned i;
+
+	for (i=0; i<n; i++) {
+		wc = &wq->wq_cpus[i];
+		spinlock_acquire(&wc->wc_lock);
+		wc->wc_exiting = true;
+		spinlock_release(&wc->wc_lock);
+		wchan_wakeone(wc->wc_wchan);
+	}
+	for (i=0; i<n; i++) {
+		P(wq->wq_done);
+	}
+}
+
+/*
+ * Free a work queue whose workers are not running, with its first N
+ * per-cpu lists set up.
+ */
+static
+void
+workqueue_free(struct workqueue *wq, unsigned n)
+{
+	unsigned i;
+
+	for (i=0; i<n; i++) {
+		KASSERT(wq->wq_cpus[i].wc_head == NULL);
+		wchan_destroy(wq->wq_cpus[i].wc_wchan);
+		spinlock_cleanup(&wq->wq_cpus[i].wc_lock);
+	}
+	if (wq->wq_done != NULL) {
+		sem_destroy(wq->wq_done);
+	}
+	kfree(wq->wq_cpus);
+	kfree(wq->wq_name);
+	kfree(wq);
+}
+
+struct workqueue *
+workqueue_create(const char *name)
+{
+	struct workqueue *wq;
+	struct wq_cpu *wc;
+	unsigned i;
+	int result;
+
+	wq = kmalloc(sizeof(*wq));
+	if (wq == NULL) {
+		return NULL;
+	}
+	wq->wq_ncpus = thread_numcpus();
+	wq->wq_done = NULL;
+	wq->wq_name = kstrdup(name);
+	if (wq->wq_name == NULL) {
+		kfree(wq);
+		return NULL;
+	}
+	wq->wq_cpus = kmalloc(wq->wq_ncpus * sizeof(struct wq_cpu));
+	if (wq->wq_cpus == NULL) {
+		kfree(wq->wq_name);
+		kfree(wq);
+		return NULL;
+	}
+
+	for (i=0; i<wq->wq_ncpus; i++) {
+		wc = &wq->wq_cpus[i];
+		wc->wc_wchan = wchan_create(wq->wq_name);
+		if (wc->wc_wchan == NULL) {
+			workqueue_free(wq, i);
+			return NULL;
+		}
+		spinlock_init(&wc->wc_lock);
+		wc->wc_head = NULL;
+		wc->wc_tailp = &wc->wc_head;
+		wc->wc_exiting = false;
+	}
+
+	wq->wq_done = sem_create(wq->wq_name, 0);
+	if (wq->wq_done == NULL) {
+		workqueue_free(wq, wq->wq_ncpus);
+		return NULL;
+	}
+
+	for (i=0; i<wq->wq_ncpus; i++) {
+		result = thread_fork_pinned(wq->wq_name, kproc, i,
+					    workqueue_worker, wq, i);
+		if (result) {
+			workqueue_stop(wq, i);
+			workqueue_free(wq, wq->wq_ncpus);
+			return NULL;
+		}
+	}
+
+	return wq;
+}
+
+void
+workqueue_destroy(struct workqueue *wq)
+{
+	workqueue_stop(wq, wq->wq_ncpus);
+	workqueue_free(wq, wq->wq_ncpus);
+}
+
+void
+work_init(struct work *w, void (*func)(void *), void *arg)
+{
+	w->w_next = NULL;
+	spinlock_data_set(&w->w_pending, 0);
+	w->w_func = func;
+	w->w_arg = arg;
+	w->w_wq = NULL;
+	timeout_init(&w->w_timeout, NULL, NULL);
+}
+
+bool
+work_enqueue(struct workqueue *wq, struct work *w)
+{
+	if (spinlock_data_testandset(&w->w_pending) != 0) {
+		return false;
+	}
+	workqueue_add(wq, w);
+	return true;
+}
+
+/*
+ * Timeout function for delayed work: the delay is up, so queue it.
+ * This runs in the timer interrupt, which workqueue_add is fine with.
+ */
+static
+void
+work_delay_done(void *arg)
+{
+	struct work *w = arg;
+
+	workqueue_add(w->w_wq, w);
+}
+
+bool
+work_enqueue_delayed(struct workqueue *wq, struct work *w, unsigned ticks)
+{
+	if (spinlock_data_testandset(&w->w_pending) != 0) {
+		return false;
+	}
+	if (ticks == 0) {
+		workqueue_add(wq, w);
+		return true;
+	}
+	w->w_wq = wq;
+	timeout_init(&w->w_timeout, work_delay_done, w);
+	timeout_add(&w->w_timeout, ticks);
+	return true;
+}
+
+/*
+ * Work items allocated by work_defer.
+ */
+struct deferred_work {
+	struct work dw_work;
+	void (*dw_func)(void *);
+	void *dw_arg;
+};
+
+static
+void
+work_run_deferred(void *arg)
+{
+	struct deferred_work *dw = arg;
+
+	dw->dw_func(dw->dw_arg);
+	kfree(dw);
+}
+
+void
+work_defer(void (*func)(void *), void *arg)
+{
+	struct deferred_work *dw;
+
+	if (system_wq == NULL) {
+		/* Too early in boot; just do it. */
+		func(arg);
+		return;
+	}
+
+	dw = kmalloc(sizeof(*dw));
+	if (dw == NULL) {
+		func(arg);
+		return;
+	}
+	dw->dw_func = func;
+	dw->dw_arg = arg;
+	work_init(&dw->dw_work, work_run_deferred, dw);
+	work_enqueue(system_wq, &dw->dw_work);
+}
+
+void
+workqueue_bootstrap(void)
+{
+	system_wq = workqueue_create("system_wq");
+	if (system_wq == NULL) {
+		panic("workqueue_bootstrap: Out of memory\n");
+	}
+}
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+/*
+ * schedtrace - collect and summarize kernel scheduler events.
+ * Usage: schedtrace on
+ *        schedtrace off
+ *        schedtrace [-t]
+ *        schedtrace [-t] prog [args...]
+ *
+ * "on" and "off" start and stop tracing. With no command, drains the
+ * events collected so far and prints, for each thread, how often and
+ * how long it ran, how long it spent blocked, and its scheduling
+ * latency (from being made runnable to being switched to). With a
+ * command, traces just while that command runs. -t also prints the
+ * context switches one by one.
+ *
+ * Times are in cpu cycles. Threads are named by their kernel
+ * addresses.
+ */
+
+#define MAXEVENTS	4096
+#define MAXTHREADS	256
+
+struct tstats {
+	uint32_t ts_thread;
+	uint64_t ts_readyat;	/* when made runnable, if waiting to run */
+	uint64_t ts_runat;	/* when switched to, if running */
+	uint64_t ts_blockat;	/* when it went to sleep, if sleeping */
+	unsigned ts_runs;
+	uint64_t ts_runtime;
+	uint64_t ts_blocktime;
+	unsigned ts_waits;
+	uint64_t ts_waittime;
+	uint64_t ts_maxwait;
+	unsigned ts_misses;
+};
+
+static struct schedtrace_event events[MAXEVENTS];
+static struct schedtrace_event scratch[MAXEVENTS];
+static unsigned nevents;
+static unsigned nlost;
+
+static struct tstats threads[MAXTHREADS];
+static unsigned nthreads;
+
+static const char *whynames[] = { "?", "yield", "block", "exit" };
+
+static
+struct tstats *
+getthread(uint32_t t)
+{
+	unsigned i;
+
+	for (i=0; i<nthreads; i++) {
+		if (threads[i].ts_thread == t) {
+			return &threads[i];
+		}
+	}
+	if (nthreads == MAXTHREADS) {
+		return NULL;
+	}
+	memset(&threads[nthreads], 0, sizeof(threads[nthreads]));
+	threads[nthreads].ts_thread = t;
+	return &threads[nthreads++];
+}
+
+/*
+ * Read everything the kernel has.
+ */
+static
+void
+readevents(void)
+{
+	int len;
+
+	while (nevents < MAXEVENTS) {
+		len = schedtrace(SCHEDTRACE_READ, &events[nevents],
+				 (MAXEVENTS - nevents) * sizeof(events[0]));
+		if (len < 0) {
+			err(1, "schedtrace");
+		}
+		if (len == 0) {
+			break;
+		}
+		nevents += len / sizeof(events[0]);
+	}
+}
+
+/*
+ * Sort the events by time. Each cpu's events come out in order, but
+ * the cpus are interleaved in chunks; a merge sort doesn't care.
+ */
+static
+void
+sortevents(void)
+{
+	unsigned width, lo, mid, hi, i, j, k;
+
+	for (width = 1; width < nevents; width *= 2) {
+		for (lo = 0; lo < nevents; lo += 2*width) {
+			mid = lo + width < nevents ? lo + width : nevents;
+			hi = lo + 2*width < nevents ? lo + 2*width : nevents;
+			i = lo;
+			j = mid;
+			k = lo;
+			while (i < mid || j < hi) {
+				if (j >= hi || (i < mid &&
+				    events[i].ste_time <= events[j].ste_time)) {
+					scratch[k++] = events[i++];
+				}
+				else {
+					scratch[k++] = events[j++];
+				}
+			}
+		}
+		memcpy(events, scratch, nevents * sizeof(events[0]));
+	}
+}
+
+static
+void
+analyze(int timeline)
+{
+	struct schedtrace_event *e;
+	struct tstats *ts, *next;
+	uint64_t wait;
+	unsigned i;
+
+	for (i=0; i<nevents; i++) {
+		e = &events[i];
+		switch (e->ste_type) {
+		    case STE_READY:
+			ts = getthread(e->ste_thread);
+			if (ts != NULL && ts->ts_readyat == 0) {
+				ts->ts_readyat = e->ste_time;
+			}
+			break;
+		    case STE_WAKE:
+			ts = getthread(e->ste_thread);
+			if (ts != NULL && ts->ts_blockat != 0) {
+				ts->ts_blocktime += e->ste_time - ts->ts_blockat;
+				ts->ts_blockat = 0;
+			}
+			break;
+		    case STE_SWITCH:
+			ts = getthread(e->ste_thread);
+			next = getthread(e->ste_arg);
+			wait = 0;
+			if (ts != NULL && ts->ts_runat != 0) {
+				ts->ts_runtime += e->ste_time - ts->ts_runat;
+				ts->ts_runat = 0;
+			}
+			if (ts != NULL && e->ste_arg2 == STE_BLOCKED) {
+				ts->ts_blockat = e->ste_time;
+			}
+			if (next != NULL) {
+				if (next->ts_readyat != 0) {
+					wait = e->ste_time - next->ts_readyat;
+					next->ts_waits++;
+					next->ts_waittime += wait;
+					if (wait > next->ts_maxwait) {
+						next->ts_maxwait = wait;
+					}
+					next->ts_readyat = 0;
+				}
+				next->ts_runat = e->ste_time;
+				next->ts_runs++;
+			}
+			if (timeline) {
+				printf("%llu cpu%u %08x -> %08x (%s) waited %llu\n",
+				       e->ste_time, e->ste_cpu,
+				       e->ste_thread, e->ste_arg,
+				       e->ste_arg2 < 4 ?
+				       whynames[e->ste_arg2] : "?",
+				       wait);
+			}
+			break;
+		    case STE_MISS:
+			ts = getthread(e->ste_thread);
+			if (ts != NULL) {
+				ts->ts_misses++;
+			}
+			if (timeline) {
+				printf("%llu cpu%u %08x missed deadline by %u\n",
+				       e->ste_time, e->ste_cpu,
+				       e->ste_thread, e->ste_arg);
+			}
+			break;
+		    case STE_LOST:
+			nlost += e->ste_arg;
+			break;
+		}
+	}
+
+	printf("%u events", nevents);
+	if (nlost > 0) {
+		printf(" (%u lost)", nlost);
+	}
+	if (nevents == MAXEVENTS) {
+		printf(" (buffer full; some not read)");
+	}
+	printf("\n");
+
+	printf("%-8s %6s %12s %12s %12s %12s %6s\n", "thread", "runs",
+	       "run", "blocked", "avg latency", "max latency", "misses");
+	for (i=0; i<nthreads; i++) {
+		ts = &threads[i];
+		if (ts->ts_runs == 0) {
+			continue;
+		}
+		printf("%08x %6u %12llu %12llu %12llu %12llu %6u\n",
+		       ts->ts_thread, ts->ts_runs, ts->ts_runtime,
+		       ts->ts_blocktime,
+		       ts->ts_waits ? ts->ts_waittime / ts->ts_waits : 0ULL,
+		       ts->ts_maxwait, ts->ts_misses);
+	}
+}
+
+/*
+ * Run a command with tracing on.
+ */
+static
+void
+runtraced(char **args)
+{
+	pid_t pid;
+	int status;
+
+	if (schedtrace(SCHEDTRACE_ON, NULL, 0) < 0) {
+		err(1, "schedtrace");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		execv(args[0], args);
+		err(1, "%s", args[0]);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		warn("waitpid");
+	}
+
+	if (schedtrace(SCHEDTRACE_OFF, NULL, 0) < 0) {
+		err(1, "schedtrace");
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	int timeline = 0;
+
+	if (argc == 2 && !strcmp(argv[1], "on")) {
+		if (schedtrace(SCHEDTRACE_ON, NULL, 0) < 0) {
+			err(1, "schedtrace");
+		}
+		return 0;
+	}
+	if (argc == 2 && !strcmp(argv[1], "off")) {
+		if (schedtrace(SCHEDTRACE_OFF, NULL, 0) < 0) {
+			err(1, "schedtrace");
+		}
+		return 0;
+	}
+
+	argv++;
+	argc--;
+	if (argc > 0 && !strcmp(argv[0], "-t")) {
+		timeline = 1;
+		argv++;
+		argc--;
+	}
+	if (argc > 0) {
+		runtraced(argv);
+	}
+
+	readevents();
+	sortevents();
+	analyze(timeline);
+	return 0;
+}
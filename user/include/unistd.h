@@ -40,8 +40,12 @@
 #include <kern/fcntl.h>
 #include <kern/ioctl.h>
 #include <kern/reboot.h>
+#include <kern/schedtrace.h>
+#include <kern/futex.h>
+#include <kern/edf.h>
 #include <kern/seek.h>
 #include <kern/time.h>
+#include <kern/resource.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
 
@@ -118,6 +122,7 @@
 __DEAD void _exit(int code);
 int execv(const char *prog, char *const *args);
 pid_t fork(void);
+pid_t spawn(const char *prog, char *const *args);	/* fork + execv */
 int waitpid(pid_t pid, int *returncode, int flags);
 /* 
  * Open actually takes either two or three args: the optional third
@@ -135,6 +140,7 @@ int rmdir(const char *dirname);
 
 /* Recommended. */
 int getpid(void);
+int getrusage(int who, struct rusage *usage);
 int ioctl(int filehandle, int code, void *buf);
 off_t lseek(int filehandle, off_t pos, int code);
 int fsync(int filehandle);
@@ -153,6 +159,14 @@ int readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int schedtrace(int op, void *buf, size_t buflen);
+int sched_edf(int op, struct edf_params *params);
+int sched_setshare(int tickets);
+int __threadfork(void (*start)(void *), void *arg);
+__DEAD void threadexit(int code);
+int threadjoin(int tid, int *status);
+int futex(volatile int *addr, int op, int val);
 int __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
@@ -163,5 +177,6 @@ int __getcwd(char *buf, size_t buflen);
 
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+int threadfork(void (*func)(void));		/* calls __threadfork */
 
 #endif /* _UNISTD_H_ */
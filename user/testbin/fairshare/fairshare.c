@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * fairshare - check that the scheduler divides cpu time among
+ * processes in proportion to their shares (see sched_setshare),
+ * however many threads each one has.
+ *
+ * Each test forks some hogs, which spin until the same moment and
+ * then exit. As the parent waits for each one it picks up the hog's
+ * cpu time with getrusage(RUSAGE_CHILDREN), and at the end checks the
+ * ratios against the shares, to within TOLERANCE percent.
+ *
+ * The hogs only compete if they share a cpu, so run this on a
+ * single-cpu machine (cpus=1 in sys161.conf).
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+
+#define SPINSECS	5	/* How long the hogs run */
+#define TOLERANCE	20	/* Allowed error, percent */
+#define MAXHOGS		4
+
+struct hog {
+	int tickets;		/* Share to ask for */
+	int nthreads;		/* Threads to spin in */
+	unsigned ms;		/* Cpu time it got */
+};
+
+static time_t endtime;
+
+static
+void
+spin(void)
+{
+	while (time(NULL) < endtime) {
+		/* nothing */
+	}
+}
+
+/*
+ * Run a hog: set its share, start its extra threads, and spin.
+ */
+static
+void
+hog(struct hog *h)
+{
+	int i;
+
+	if (sched_setshare(h->tickets) < 0) {
+		err(1, "sched_setshare");
+	}
+	for (i=1; i<h->nthreads; i++) {
+		if (threadfork(spin) < 0) {
+			err(1, "threadfork");
+		}
+	}
+	spin();
+	/* Stops any other threads too. */
+	_exit(0);
+}
+
+/*
+ * Total cpu time of the children waited for so far, in ms.
+ */
+static
+unsigned
+childms(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_CHILDREN, &ru) < 0) {
+		err(1, "getrusage");
+	}
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000 +
+		(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000;
+}
+
+/*
+ * Run NHOGS hogs against each other. Returns 0 if each got its share
+ * of the time the first one got.
+ */
+static
+int
+race(const char *name, struct hog *hogs, int nhogs)
+{
+	pid_t pids[MAXHOGS];
+	unsigned before, after, expect, diff;
+	int i, status, ret;
+
+	/* Start at the top of a second so everyone gets the whole time. */
+	endtime = time(NULL) + SPINSECS + 1;
+
+	for (i=0; i<nhogs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			hog(&hogs[i]);
+		}
+	}
+
+	before = childms();
+	for (i=0; i<nhogs; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		after = childms();
+		hogs[i].ms = after - before;
+		before = after;
+	}
+
+	printf("%s:\n", name);
+	ret = 0;
+	for (i=0; i<nhogs; i++) {
+		expect = hogs[0].ms * hogs[i].tickets / hogs[0].tickets;
+		diff = hogs[i].ms > expect ?
+			hogs[i].ms - expect : expect - hogs[i].ms;
+		printf("  %d tickets, %d threads: %u ms (expected %u)\n",
+		       hogs[i].tickets, hogs[i].nthreads, hogs[i].ms, expect);
+		if (expect == 0 || diff * 100 > expect * TOLERANCE) {
+			warnx("%s: hog %d is off by more than %d%%",
+			      name, i, TOLERANCE);
+			ret = 1;
+		}
+	}
+	return ret;
+}
+
+int
+main(void)
+{
+	struct hog weighted[2] = {
+		{ 100, 1, 0 },
+		{ 300, 1, 0 },
+	};
+	struct hog threaded[2] = {
+		{ 100, 1, 0 },
+		{ 100, 4, 0 },
+	};
+	int failed = 0;
+
+	failed += race("Shares 1:3", weighted, 2);
+	failed += race("One thread vs. four", threaded, 2);
+
+	if (failed) {
+		errx(1, "FAILED");
+	}
+	printf("fairshare: passed\n");
+	return 0;
+}
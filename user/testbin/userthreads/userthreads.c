@@ -80,7 +80,8 @@ main(int argc, char *argv[])
     }
 
     printf("Parent has left.\n");
-    return 0;
+    /* Returning from main would exit the whole process. */
+    threadexit(0);
 }
 
 /* multiple threads will simply print out the global variable.